@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that share a lifetime, such as the nodes of one
+// parsed program. Objects are laid out back to back in large blocks and are
+// all destroyed together when the Arena is.
+class Arena {
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+  // Destructor to run for an allocation, kept in a list threaded through the
+  // arena itself (newest first).
+  struct Cleanup {
+    void (*destroy)(void *objects, size_t count);
+    void *objects;
+    size_t count;
+    Cleanup *next;
+  };
+
+  std::vector<std::unique_ptr<std::byte[]>> blocks;
+  std::byte *next = nullptr;
+  std::byte *end = nullptr;
+  Cleanup *cleanups = nullptr;
+
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  ~Arena() {
+    for (Cleanup *cleanup = cleanups; cleanup != nullptr;
+         cleanup = cleanup->next) {
+      cleanup->destroy(cleanup->objects, cleanup->count);
+    }
+  }
+
+  template <class T, class... Args> T *make(Args &&...args) {
+    T *object = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    registerCleanup(object, 1);
+    return object;
+  }
+
+  // Copies `items` into the arena
+  template <class T> std::span<const T> array(const std::vector<T> &items) {
+    if (items.empty()) {
+      return {};
+    }
+
+    T *objects =
+        static_cast<T *>(allocate(sizeof(T) * items.size(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), objects);
+    registerCleanup(objects, items.size());
+    return {objects, items.size()};
+  }
+
+private:
+  void *allocate(size_t size, size_t alignment) {
+    auto address = reinterpret_cast<std::uintptr_t>(next);
+    size_t padding = (alignment - address % alignment) % alignment;
+
+    if (next == nullptr ||
+        static_cast<size_t>(end - next) < padding + size) {
+      size_t blockSize = std::max(BLOCK_SIZE, size + alignment);
+      blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(blockSize));
+      next = blocks.back().get();
+      end = next + blockSize;
+
+      address = reinterpret_cast<std::uintptr_t>(next);
+      padding = (alignment - address % alignment) % alignment;
+    }
+
+    void *memory = next + padding;
+    next += padding + size;
+    return memory;
+  }
+
+  template <class T> void registerCleanup(T *objects, size_t count) {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      auto *cleanup = new (allocate(sizeof(Cleanup), alignof(Cleanup)))
+          Cleanup{[](void *items, size_t n) {
+                    std::destroy_n(static_cast<T *>(items), n);
+                  },
+                  objects, count, cleanups};
+      cleanups = cleanup;
+    }
+  }
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+// Where the Resolver found a variable. Locals of a scope no closure captures
+// live on the engine's value stack, `slot` places past the start of the
+// running call's frame. Locals of a captured scope live in Environments:
+// `depth` environments up the chain from the current one, at `slot` within
+// that environment. Variables the Resolver did not find in any local scope
+// keep depth -1 and are globals.
+struct Binding {
+  int depth = -1;
+  int slot = -1;
+  // For globals: the slot in Globals, cached by the Interpreter the first
+  // time this site runs
+  int global = -1;
+  bool onStack = false;
+
+  [[nodiscard]] bool isLocal() const { return onStack || depth >= 0; }
+};
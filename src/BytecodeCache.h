@@ -0,0 +1,444 @@
+#pragma once
+
+#include "Chunk.h"
+#include "Globals.h"
+#include "LoxString.h"
+#include "ObjFunction.h"
+#include "Source.h"
+#include "StackDepth.h"
+#include "SymbolTable.h"
+#include "Value.h"
+#include <cstdint>
+#include <cstdio>  // std::rename, std::remove
+#include <cstring> // std::memcpy
+#include <fstream>
+#include <functional> // std::hash
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unistd.h> // getpid
+#include <vector>
+
+// Caches the bytecode the Compiler produces for a script in a file next to
+// it, so later runs of an unchanged script skip scanning, parsing, resolving
+// and compiling. The file is mapped and decoded straight into ObjFunctions.
+//
+// A cache file holds a header, the names of the globals the code refers to
+// by slot, and the top-level function:
+//
+//   "LOXC" version:u32 optimized:u8 sourceHash:u64 bodyHash:u64
+//   body := globalCount:u32 name* function
+//   function := name arity:i32 upvalueCount:i32
+//               codeSize:u32 code:u8[codeSize] lines:i32[codeSize]
+//               constantCount:u32 constant*
+//   constant := NIL | FALSE | TRUE | NUMBER f64 | STRING name
+//             | FUNCTION function
+//   name := size:u32 bytes
+//
+// The VM runs its bytecode unchecked. The body's hash guards against a
+// truncated or damaged file, and every function's operands are checked as it
+// is read: jump targets, constants, upvalues and global slots against the
+// function, and local slots and call arguments against the stack depth at
+// each instruction (see StackDepth).
+// Numbers are stored in the machine's byte order, so a cache is only read on
+// the kind of machine that wrote it; a mismatch shows as a wrong version.
+// Global slots depend on the Globals the code was compiled against, so they
+// are renumbered against the loading VM's Globals by name.
+class BytecodeCache {
+  static constexpr std::string_view MAGIC = "LOXC";
+  // Bump whenever the format or the bytecode changes
+  static constexpr std::uint32_t VERSION = 1;
+
+  enum Tag : std::uint8_t { NIL, FALSE, TRUE, NUMBER, STRING, FUNCTION };
+
+  // As many as the 1-byte upvalue operands can address
+  static constexpr int MAX_UPVALUES =
+      std::numeric_limits<std::uint8_t>::max() + 1;
+
+  class Writer {
+    std::string bytes;
+
+  public:
+    template <class T> void write(T value) {
+      static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>);
+      bytes.append(reinterpret_cast<const char *>(&value), sizeof value);
+    }
+
+    void writeName(std::string_view name) {
+      write(static_cast<std::uint32_t>(name.size()));
+      bytes.append(name);
+    }
+
+    void writeFunction(const ObjFunction &function) {
+      writeName(function.name);
+      write(static_cast<std::int32_t>(function.arity));
+      write(static_cast<std::int32_t>(function.upvalueCount));
+
+      const Chunk &chunk = function.chunk;
+      write(static_cast<std::uint32_t>(chunk.code.size()));
+      bytes.append(reinterpret_cast<const char *>(chunk.code.data()),
+                   chunk.code.size());
+      for (int line : chunk.lines) {
+        write(static_cast<std::int32_t>(line));
+      }
+
+      write(static_cast<std::uint32_t>(chunk.constants.size()));
+      for (const Value &constant : chunk.constants) {
+        if (constant.isNil()) {
+          write(NIL);
+        } else if (constant.isBool()) {
+          write(constant.asBool() ? TRUE : FALSE);
+        } else if (constant.isNumber()) {
+          write(NUMBER);
+          write(constant.asNumber());
+        } else if (constant.isString()) {
+          write(STRING);
+          writeName(constant.asString());
+        } else {
+          write(FUNCTION);
+          writeFunction(*constant.asObj<ObjFunction>());
+        }
+      }
+    }
+
+    [[nodiscard]] const std::string &data() const { return bytes; }
+  };
+
+  // Reads from the mapped file. Running past its end or finding anything
+  // malformed sets `failed` rather than throwing.
+  class Reader {
+    std::string_view bytes;
+
+  public:
+    bool failed = false;
+
+    Reader(std::string_view bytes) : bytes{bytes} {}
+
+    template <class T> T read() {
+      T value{};
+      if (bytes.size() < sizeof value) {
+        failed = true;
+        return value;
+      }
+      std::memcpy(&value, bytes.data(), sizeof value);
+      bytes.remove_prefix(sizeof value);
+      return value;
+    }
+
+    std::string_view readBytes(size_t size) {
+      if (bytes.size() < size) {
+        failed = true;
+        return {};
+      }
+      std::string_view read = bytes.substr(0, size);
+      bytes.remove_prefix(size);
+      return read;
+    }
+
+    [[nodiscard]] std::string_view rest() const { return bytes; }
+
+    std::string_view readName() { return readBytes(read<std::uint32_t>()); }
+
+    // Reads a count of items that take at least `itemSize` bytes each, failing
+    // if the rest of the file can't hold that many
+    std::uint32_t readCount(size_t itemSize) {
+      auto count = read<std::uint32_t>();
+      if (count > bytes.size() / itemSize) {
+        failed = true;
+        return 0;
+      }
+      return count;
+    }
+
+    // `globals` maps the cache's global slots to the loading VM's
+    Value readFunction(const std::vector<std::uint32_t> &globals) {
+      Value function = Value{new ObjFunction{std::string{readName()}}};
+      auto *compiled = function.asObj<ObjFunction>();
+      compiled->arity = read<std::int32_t>();
+      compiled->upvalueCount = read<std::int32_t>();
+
+      Chunk &chunk = compiled->chunk;
+      auto codeSize = read<std::uint32_t>();
+      std::string_view code = readBytes(codeSize);
+      chunk.code.assign(code.begin(), code.end());
+      chunk.lines.resize(chunk.code.size());
+      for (int &line : chunk.lines) {
+        line = read<std::int32_t>();
+      }
+
+      std::uint32_t constantCount = readCount(sizeof(Tag));
+      for (std::uint32_t i = 0; i < constantCount && !failed; i++) {
+        switch (read<std::uint8_t>()) {
+        case NIL:
+          chunk.constants.emplace_back(nullptr);
+          break;
+        case FALSE:
+          chunk.constants.emplace_back(false);
+          break;
+        case TRUE:
+          chunk.constants.emplace_back(true);
+          break;
+        case NUMBER:
+          chunk.constants.emplace_back(read<double>());
+          break;
+        case STRING:
+          chunk.constants.emplace_back(
+              LoxString::intern(std::string{readName()}));
+          break;
+        case FUNCTION:
+          chunk.constants.push_back(readFunction(globals));
+          break;
+        default:
+          failed = true;
+        }
+      }
+
+      if (!failed) {
+        failed = !verify(*compiled, globals);
+      }
+      return function;
+    }
+  };
+
+public:
+  // The cache file of a script
+  static std::string path(std::string_view script) {
+    return std::string{script} + "c";
+  }
+
+  // Returns the script's top-level function, or nil if the cache file is
+  // missing, unreadable, or was written for a different source, version or
+  // optimization setting
+  static Value load(const std::string &cachePath, std::string_view source,
+                    bool optimized, Globals &globals) {
+    std::shared_ptr<Source> file = Source::map(cachePath.c_str());
+    if (!file) {
+      return nullptr;
+    }
+
+    Reader reader{file->view()};
+    if (reader.readBytes(MAGIC.size()) != MAGIC ||
+        reader.read<std::uint32_t>() != VERSION ||
+        reader.read<std::uint8_t>() != (optimized ? 1 : 0) ||
+        reader.read<std::uint64_t>() != hash(source)) {
+      return nullptr;
+    }
+    auto bodyHash = reader.read<std::uint64_t>();
+    if (reader.failed || hash(reader.rest()) != bodyHash) {
+      return nullptr;
+    }
+
+    std::vector<std::uint32_t> slots(
+        reader.readCount(sizeof(std::uint32_t)));
+    for (std::uint32_t &slot : slots) {
+      slot = static_cast<std::uint32_t>(
+          globals.slot(symbols.intern(reader.readName())));
+      if (reader.failed) {
+        return nullptr;
+      }
+    }
+
+    Value function = reader.readFunction(slots);
+    if (reader.failed) {
+      return nullptr;
+    }
+    return function;
+  }
+
+  // Writes the cache file, replacing any previous one. A file that can't be
+  // written is skipped: the cache only saves time.
+  static void save(const std::string &cachePath, std::string_view source,
+                   bool optimized, const Value &function,
+                   const Globals &globals) {
+    Writer body;
+    body.write(static_cast<std::uint32_t>(globals.count()));
+    for (int slot = 0; slot < globals.count(); slot++) {
+      body.writeName(globals.name(slot));
+    }
+    body.writeFunction(*function.asObj<ObjFunction>());
+
+    Writer header;
+    for (char c : MAGIC) {
+      header.write(c);
+    }
+    header.write(VERSION);
+    header.write(static_cast<std::uint8_t>(optimized ? 1 : 0));
+    header.write(hash(source));
+    header.write(hash(body.data()));
+
+    // Write to a file of our own and rename it into place, so that scripts
+    // run at the same time never see half a cache file
+    size_t thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    std::string temporary = cachePath + ".tmp" + std::to_string(getpid()) +
+                            "-" + std::to_string(thread);
+    {
+      std::ofstream out{temporary, std::ios::binary};
+      for (const Writer *part : {&header, &body}) {
+        out.write(part->data().data(),
+                  static_cast<std::streamsize>(part->data().size()));
+      }
+      if (!out) {
+        out.close();
+        std::remove(temporary.c_str());
+        return;
+      }
+    }
+    if (std::rename(temporary.c_str(), cachePath.c_str()) != 0) {
+      std::remove(temporary.c_str());
+    }
+  }
+
+private:
+  // 64-bit FNV-1a
+  static std::uint64_t hash(std::string_view text) {
+    std::uint64_t hash = 14695981039346656037U;
+    for (char c : text) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211U;
+    }
+    return hash;
+  }
+
+  static int operandSize(std::uint8_t op, const Chunk &chunk, size_t offset) {
+    switch (op) {
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_CALL:
+    case OP_TAIL_CALL:
+      return 1;
+    case OP_CONSTANT:
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+      return 2;
+    case OP_DEFINE_GLOBAL:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+      return 4;
+    case OP_CLOSURE: {
+      if (offset + 2 >= chunk.code.size()) {
+        return -1;
+      }
+      size_t constant = (chunk.code[offset + 1] << 8) | chunk.code[offset + 2];
+      if (constant >= chunk.constants.size() ||
+          !chunk.constants[constant].isObjType(ObjType::COMPILED_FUNCTION)) {
+        return -1;
+      }
+      auto *function = chunk.constants[constant].asObj<ObjFunction>();
+      return 2 + 2 * function->upvalueCount;
+    }
+    default:
+      return op <= OP_RETURN ? 0 : -1;
+    }
+  }
+
+  // Checks the operands of a function's code against the function, and
+  // rewrites its global slot operands from the cache's slots to the loading
+  // VM's. Its nested functions have been checked already. Returns false if the
+  // code is malformed.
+  static bool verify(ObjFunction &function,
+                     const std::vector<std::uint32_t> &slots) {
+    if (function.arity < 0 || function.upvalueCount < 0 ||
+        function.upvalueCount > MAX_UPVALUES) {
+      return false;
+    }
+
+    Chunk &chunk = function.chunk;
+    std::vector<std::uint8_t> &code = chunk.code;
+    // Jumps may only land where an instruction starts
+    std::vector<bool> starts(code.size());
+    std::vector<size_t> targets;
+    std::uint8_t last = OP_CONSTANT;
+    for (size_t offset = 0; offset < code.size();) {
+      std::uint8_t op = code[offset];
+      int size = operandSize(op, chunk, offset);
+      if (size < 0 || offset + size >= code.size()) {
+        return false;
+      }
+      starts[offset] = true;
+      last = op;
+
+      size_t operand = 0;
+      if (size >= 2) {
+        operand = (code[offset + 1] << 8) | code[offset + 2];
+      }
+      switch (op) {
+      case OP_CONSTANT:
+        if (operand >= chunk.constants.size() ||
+            chunk.constants[operand].isObjType(ObjType::COMPILED_FUNCTION)) {
+          return false;
+        }
+        break;
+      case OP_GET_UPVALUE:
+      case OP_SET_UPVALUE:
+        if (code[offset + 1] >= function.upvalueCount) {
+          return false;
+        }
+        break;
+      case OP_JUMP:
+      case OP_JUMP_IF_FALSE:
+        targets.push_back(offset + 3 + operand);
+        break;
+      case OP_LOOP:
+        if (operand > offset + 3) {
+          return false;
+        }
+        targets.push_back(offset + 3 - operand);
+        break;
+      case OP_CLOSURE:
+        // Each upvalue captures a local of this frame or one of its upvalues
+        for (int i = 3; i <= size; i += 2) {
+          std::uint8_t isLocal = code[offset + i];
+          std::uint8_t index = code[offset + i + 1];
+          if (isLocal > 1 || (isLocal == 0 && index >= function.upvalueCount)) {
+            return false;
+          }
+        }
+        break;
+      case OP_DEFINE_GLOBAL:
+      case OP_GET_GLOBAL:
+      case OP_SET_GLOBAL: {
+        std::uint32_t slot = 0;
+        for (int i = 1; i <= 4; i++) {
+          slot = (slot << 8) | code[offset + i];
+        }
+        if (slot >= slots.size()) {
+          return false;
+        }
+        slot = slots[slot];
+        for (int i = 4; i >= 1; i--) {
+          code[offset + i] = static_cast<std::uint8_t>(slot & 0xff);
+          slot >>= 8;
+        }
+        break;
+      }
+      default:
+        break;
+      }
+
+      offset += 1 + size;
+    }
+
+    // The code must not run off its end
+    if (last != OP_RETURN) {
+      return false;
+    }
+    for (size_t target : targets) {
+      if (target >= code.size() || !starts[target]) {
+        return false;
+      }
+    }
+
+    // Now that the instructions are known to be well formed, follow the
+    // stack through them, as the Compiler did
+    std::optional<StackDepth::Result> depth = StackDepth::measure(function);
+    return depth && depth->max <= StackDepth::FRAME_SLOTS;
+  }
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Value.h"
+#include <cstdint>
+#include <vector>
+
+enum OpCode : std::uint8_t {
+  // Operands are 1 byte unless noted. Constant and jump operands are 2 bytes
+  // and global slots are 4 bytes (big-endian).
+  OP_CONSTANT,      // [constant]
+  OP_NIL,
+  OP_TRUE,
+  OP_FALSE,
+  OP_POP,
+  OP_GET_LOCAL,     // [slot]
+  OP_SET_LOCAL,     // [slot]
+  OP_GET_UPVALUE,   // [index]
+  OP_SET_UPVALUE,   // [index]
+  OP_DEFINE_GLOBAL, // [global slot]
+  OP_GET_GLOBAL,    // [global slot]
+  OP_SET_GLOBAL,    // [global slot]
+  OP_EQUAL,
+  OP_NOT_EQUAL,
+  OP_GREATER,
+  OP_GREATER_EQUAL,
+  OP_LESS,
+  OP_LESS_EQUAL,
+  OP_ADD,
+  OP_SUBTRACT,
+  OP_MULTIPLY,
+  OP_DIVIDE,
+  OP_NOT,
+  OP_NEGATE,
+  OP_PRINT,
+  OP_JUMP,          // [offset]
+  OP_JUMP_IF_FALSE, // [offset]
+  OP_LOOP,          // [offset]
+  OP_CALL,          // [argument count]
+  OP_TAIL_CALL,     // [argument count]
+  OP_CLOSURE,       // [function constant] then [isLocal, index] per upvalue
+  OP_CLOSE_UPVALUE,
+  OP_RETURN,
+};
+
+// A compiled sequence of bytecode with its constant pool. `lines` runs
+// parallel to `code` so runtime errors can report a source line.
+struct Chunk {
+  std::vector<std::uint8_t> code;
+  std::vector<int> lines;
+  std::vector<Value> constants;
+
+  void write(std::uint8_t byte, int line) {
+    code.push_back(byte);
+    lines.push_back(line);
+  }
+
+  size_t addConstant(Value value) {
+    constants.push_back(std::move(value));
+    return constants.size() - 1;
+  }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Collector.h"
+#include "Environment.h"
+#include "Obj.h"
+#include "Value.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Code produced by the ClosureInterpreter: each node of the syntax tree
+// becomes a C++ callable with its operands already bound.
+using Eval = std::function<Value()>;
+using Exec = std::function<void()>;
+
+// A function declared under the ClosureInterpreter. Every function created
+// from the same declaration shares its compiled body.
+class ClosureFunction : public Obj, public Traced {
+public:
+  struct Code {
+    std::string name;
+    int line;
+    size_t arity;
+    // Whether closures capture the parameters and body's scope, which then
+    // gets an Environment rather than a frame on the value stack
+    bool captured;
+    std::vector<Exec> body;
+  };
+
+  const std::shared_ptr<const Code> code;
+  std::shared_ptr<Environment> closure;
+
+  ClosureFunction(std::shared_ptr<const Code> code,
+                  std::shared_ptr<Environment> closure)
+      : Obj{ObjType::CLOSURE_FUNCTION}, code{std::move(code)},
+        closure{std::move(closure)} {}
+
+  std::string toString() override { return "<fn " + code->name + ">"; }
+
+  [[nodiscard]] std::int64_t references() const override { return owners(); }
+
+  void trace(const Visit &visit) const override {
+    if (closure != nullptr) {
+      visit(closure.get());
+    }
+  }
+
+  void clear() override { closure = nullptr; }
+
+  std::shared_ptr<void> keepAlive() override {
+    return Traced::keepAlive(this);
+  }
+};
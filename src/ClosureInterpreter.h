@@ -0,0 +1,656 @@
+#pragma once
+
+#include "Binding.h"
+#include "ClosureFunction.h"
+#include "Environment.h"
+#include "Error.h"
+#include "Expr.h"
+#include "Globals.h"
+#include "LineProfiler.h"
+#include "NativeFunction.h"
+#include "Natives.h"
+#include "Profiler.h"
+#include "Program.h"
+#include "RuntimeError.h"
+#include "Stmt.h"
+#include "SymbolTable.h"
+#include "Value.h"
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Runs a program by first compiling every node of its syntax tree into a C++
+// closure (see ClosureFunction.h) and then calling the closures. Operands,
+// operators and variable bindings are looked at once, when the closure is
+// built, rather than on every visit as in the Interpreter. Operand shapes that
+// are common in loops, such as a local compared with a constant, get closures
+// of their own that read the operands directly.
+//
+// Values, the value stack, Environments, Globals and the `returning` signal
+// work exactly as they do in the Interpreter, except that global slots are
+// looked up once at compile time.
+class ClosureInterpreter : public ExprVisitor, public StmtVisitor {
+public:
+  Globals globals;
+  // Set to profile calls to Lox functions
+  Profiler *profiler = nullptr;
+  // Set to count every node run. Nodes are counted by the closures compiled
+  // for them, so operands a closure reads in place aren't counted separately.
+  LineProfiler *lineProfiler = nullptr;
+
+private:
+  // Innermost scope a closure captured; nullptr if there is none
+  std::shared_ptr<Environment> environment = nullptr;
+  // Locals of the scopes closures don't capture, one frame per call
+  std::vector<Value> stack;
+  // Where the running call's frame starts in `stack`
+  size_t frame = 0;
+  // Every program run so far that declares functions. Compiled closures refer
+  // to their tokens, and compiled functions outlive the run.
+  std::vector<Program> programs;
+  // Set by a return statement and cleared by the call that receives it
+  bool returning = false;
+  Value returnValue;
+  // Left by a return in tail position for the returning call to run in place
+  // of its own frame
+  Value tailCallee;
+  std::vector<Value> tailArguments;
+
+  // Result of the last visit
+  Eval compiledExpr;
+  Exec compiledStmt;
+  // Where print statements write
+  std::ostream &out;
+  ErrorReporter &errors;
+
+public:
+  ClosureInterpreter(std::ostream &out, ErrorReporter &errors)
+      : out{out}, errors{errors} {
+    NativeRegistry::standard().defineAll(globals);
+  }
+
+  // Compiles the program, keeping it alive for as long as the
+  // ClosureInterpreter if it declares functions. The result can be run any
+  // number of times while the caller keeps the program.
+  std::vector<Exec> load(const Program &program) {
+    if (program.declaresFunctions) {
+      programs.push_back(program);
+    }
+    return compile(program.statements);
+  }
+
+  void run(const std::vector<Exec> &statements) {
+    try {
+      for (const Exec &statement : statements) {
+        statement();
+      }
+    } catch (const RuntimeError &error) {
+      // Unwind to the top level
+      environment = nullptr;
+      stack.clear();
+      frame = 0;
+      errors.runtimeError(error);
+    }
+  }
+
+  // Statements
+  void visitBlockStmt(Block *stmt) override {
+    std::vector<Exec> statements = compile(stmt->statements);
+
+    if (stmt->captured) {
+      compiledStmt = [this, statements] {
+        executeBlock(statements, Environment::make(environment));
+      };
+      return;
+    }
+
+    compiledStmt = [this, statements] {
+      size_t top = stack.size();
+      executeStatements(statements);
+      stack.resize(top);
+    };
+  }
+
+  void visitExpressionStmt(Expression *stmt) override {
+    compiledStmt = [expression = compile(stmt->expression)] { expression(); };
+  }
+
+  void visitFunctionStmt(Function *stmt) override {
+    auto code = std::make_shared<ClosureFunction::Code>();
+    code->name = stmt->name.lexeme;
+    code->line = stmt->name.line;
+    code->arity = stmt->params.size();
+    code->captured = stmt->captured;
+    code->body = compile(stmt->body);
+
+    compiledStmt = define(
+        stmt->name, stmt->binding,
+        [this, code = std::shared_ptr<const ClosureFunction::Code>{code}] {
+          return Value{new ClosureFunction{code, environment}};
+        });
+  }
+
+  void visitIfStmt(If *stmt) override {
+    Eval condition = compile(stmt->condition);
+    Exec thenBranch = compile(stmt->thenBranch);
+
+    if (stmt->elseBranch == nullptr) {
+      compiledStmt = [condition, thenBranch] {
+        if (isTruthy(condition())) {
+          thenBranch();
+        }
+      };
+      return;
+    }
+
+    Exec elseBranch = compile(stmt->elseBranch);
+    compiledStmt = [condition, thenBranch, elseBranch] {
+      if (isTruthy(condition())) {
+        thenBranch();
+      } else {
+        elseBranch();
+      }
+    };
+  }
+
+  void visitPrintStmt(Print *stmt) override {
+    compiledStmt = [this, expression = compile(stmt->expression)] {
+      out << stringify(expression()) << "\n";
+    };
+  }
+
+  void visitReturnStmt(Return *stmt) override {
+    if (stmt->tail) {
+      auto *call = static_cast<Call *>(stmt->value);
+      compiledStmt = [this, callee = compile(call->callee),
+                      arguments = compile(call->arguments),
+                      paren = call->paren] {
+        Value function = callee();
+        size_t base = push(arguments);
+        if (function.isObjType(ObjType::NATIVE)) {
+          // A native has no frame to run in place of this one's
+          returnValue = callNative(paren, function, base);
+        } else {
+          // The blocks being left pop the stack, so the arguments wait in
+          // tailArguments, whose storage is reused from call to call. Only
+          // now that they are evaluated, along with any tail calls they
+          // make, is tailCallee set.
+          callable(paren, function, stack.size() - base);
+          tailCallee = std::move(function);
+          tailArguments.clear();
+          for (size_t i = base; i < stack.size(); i++) {
+            tailArguments.push_back(std::move(stack[i]));
+          }
+          stack.resize(base);
+        }
+        returning = true;
+      };
+      return;
+    }
+
+    if (stmt->value == nullptr) {
+      compiledStmt = [this] {
+        returnValue = nullptr;
+        returning = true;
+      };
+      return;
+    }
+
+    compiledStmt = [this, value = compile(stmt->value)] {
+      returnValue = value();
+      returning = true;
+    };
+  }
+
+  void visitVarStmt(Var *stmt) override {
+    if (stmt->initializer == nullptr) {
+      compiledStmt = define(stmt->name, stmt->binding, [] { return Value{}; });
+    } else {
+      compiledStmt =
+          define(stmt->name, stmt->binding, compile(stmt->initializer));
+    }
+  }
+
+  void visitWhileStmt(While *stmt) override {
+    compiledStmt = [this, condition = compile(stmt->condition),
+                    body = compile(stmt->body)] {
+      while (isTruthy(condition())) {
+        body();
+        if (returning) {
+          break;
+        }
+      }
+    };
+  }
+
+  // Expressions
+  Value visitAssignExpr(Assign *expr) override {
+    Eval value = compile(expr->value);
+    const Binding &binding = expr->binding;
+
+    if (!binding.isLocal()) {
+      compiledExpr = [this, value, name = expr->name,
+                      slot = globals.slot(expr->name.symbol())] {
+        Value result = value();
+        globals.assign(slot, name, result);
+        return result;
+      };
+    } else if (binding.onStack) {
+      compiledExpr = [this, value, slot = binding.slot] {
+        Value result = value();
+        stack[frame + slot] = result;
+        return result;
+      };
+    } else if (binding.depth == 0) {
+      compiledExpr = [this, value, slot = binding.slot] {
+        Value result = value();
+        environment->assignAt(0, slot, result);
+        return result;
+      };
+    } else {
+      compiledExpr = [this, value, depth = binding.depth, slot = binding.slot] {
+        Value result = value();
+        environment->assignAt(depth, slot, result);
+        return result;
+      };
+    }
+    return {};
+  }
+
+  Value visitBinaryExpr(Binary *expr) override {
+    switch (expr->op.type) {
+    case BANG_EQUAL:
+      compiledExpr = binary(expr, [](const Token &, const Value &a,
+                                     const Value &b) -> Value {
+        return !isEqual(a, b);
+      });
+      break;
+    case EQUAL_EQUAL:
+      compiledExpr = binary(expr, [](const Token &, const Value &a,
+                                     const Value &b) -> Value {
+        return isEqual(a, b);
+      });
+      break;
+    case GREATER:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        checkNumberOperands(op, a, b);
+        return a.asNumber() > b.asNumber();
+      });
+      break;
+    case GREATER_EQUAL:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        checkNumberOperands(op, a, b);
+        return a.asNumber() >= b.asNumber();
+      });
+      break;
+    case LESS:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        checkNumberOperands(op, a, b);
+        return a.asNumber() < b.asNumber();
+      });
+      break;
+    case LESS_EQUAL:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        checkNumberOperands(op, a, b);
+        return a.asNumber() <= b.asNumber();
+      });
+      break;
+    case MINUS:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        checkNumberOperands(op, a, b);
+        return a.asNumber() - b.asNumber();
+      });
+      break;
+    case PLUS:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        if (a.isNumber() && b.isNumber()) {
+          return a.asNumber() + b.asNumber();
+        }
+        if (a.isString() && b.isString()) {
+          return concatenate(a, b);
+        }
+
+        throw RuntimeError(op, "Operands must be two numbers or two strings.");
+      });
+      break;
+    case SLASH:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        checkNumberOperands(op, a, b);
+        return a.asNumber() / b.asNumber();
+      });
+      break;
+    case STAR:
+      compiledExpr = binary(expr, [](const Token &op, const Value &a,
+                                     const Value &b) -> Value {
+        checkNumberOperands(op, a, b);
+        return a.asNumber() * b.asNumber();
+      });
+      break;
+    default:
+      // Unreachable
+      break;
+    }
+    return {};
+  }
+
+  Value visitCallExpr(Call *expr) override {
+    compiledExpr = [this, callee = compile(expr->callee),
+                    arguments = compile(expr->arguments),
+                    paren = expr->paren] {
+      Value function = callee();
+      size_t base = push(arguments);
+      if (function.isObjType(ObjType::NATIVE)) {
+        return callNative(paren, function, base);
+      }
+      return call(paren, function, base);
+    };
+    return {};
+  }
+
+  Value visitGroupingExpr(Grouping *expr) override {
+    compiledExpr = compile(expr->expression);
+    return {};
+  }
+
+  Value visitLiteralExpr(Literal *expr) override {
+    compiledExpr = [value = expr->value] { return value; };
+    return {};
+  }
+
+  Value visitLogicalExpr(Logical *expr) override {
+    Eval left = compile(expr->left);
+    Eval right = compile(expr->right);
+
+    if (expr->op.type == OR) {
+      compiledExpr = [left, right] {
+        Value value = left();
+        return isTruthy(value) ? value : right();
+      };
+    } else {
+      compiledExpr = [left, right] {
+        Value value = left();
+        return isTruthy(value) ? right() : value;
+      };
+    }
+    return {};
+  }
+
+  Value visitUnaryExpr(Unary *expr) override {
+    Eval right = compile(expr->right);
+
+    if (expr->op.type == MINUS) {
+      compiledExpr = [right, op = expr->op]() -> Value {
+        Value value = right();
+        checkNumberOperand(op, value);
+        return -value.asNumber();
+      };
+    } else {
+      compiledExpr = [right]() -> Value { return !isTruthy(right()); };
+    }
+    return {};
+  }
+
+  Value visitVariableExpr(Variable *expr) override {
+    const Binding &binding = expr->binding;
+
+    if (!binding.isLocal()) {
+      compiledExpr = [this, name = expr->name,
+                      slot = globals.slot(expr->name.symbol())] {
+        return globals.get(slot, name);
+      };
+    } else if (binding.onStack) {
+      compiledExpr = [this, slot = binding.slot] { return stack[frame + slot]; };
+    } else if (binding.depth == 0) {
+      compiledExpr = [this, slot = binding.slot] {
+        return environment->getAt(0, slot);
+      };
+    } else {
+      compiledExpr = [this, depth = binding.depth, slot = binding.slot] {
+        return environment->getAt(depth, slot);
+      };
+    }
+    return {};
+  }
+
+private:
+  Eval compile(Expr *expr) {
+    expr->accept(*this);
+    if (lineProfiler != nullptr) {
+      return [count = &lineProfiler->counter(expr),
+              eval = std::move(compiledExpr)] {
+        ++*count;
+        return eval();
+      };
+    }
+    return std::move(compiledExpr);
+  }
+
+  Exec compile(Stmt *stmt) {
+    stmt->accept(*this);
+    if (lineProfiler != nullptr) {
+      return [count = &lineProfiler->counter(stmt),
+              exec = std::move(compiledStmt)] {
+        ++*count;
+        exec();
+      };
+    }
+    return std::move(compiledStmt);
+  }
+
+  std::vector<Eval> compile(std::span<Expr *const> expressions) {
+    std::vector<Eval> compiled;
+    compiled.reserve(expressions.size());
+    for (Expr *expression : expressions) {
+      compiled.push_back(compile(expression));
+    }
+
+    return compiled;
+  }
+
+  // Evaluates call arguments onto the value stack, where the callee's frame
+  // will start, and returns the index of the first
+  size_t push(const std::vector<Eval> &arguments) {
+    size_t base = stack.size();
+    for (const Eval &argument : arguments) {
+      stack.push_back(argument());
+    }
+
+    return base;
+  }
+
+  std::vector<Exec> compile(std::span<Stmt *const> statements) {
+    std::vector<Exec> compiled;
+    compiled.reserve(statements.size());
+    for (Stmt *statement : statements) {
+      compiled.push_back(compile(statement));
+    }
+
+    return compiled;
+  }
+
+  // Builds the closure for a binary operator that computes its result with
+  // `apply`. Locals on the value stack and number constants are read in place
+  // instead of through a closure of their own.
+  template <class Apply> Eval binary(Binary *expr, Apply apply) {
+    const Token &op = expr->op;
+    std::optional<int> leftSlot = stackSlot(expr->left);
+    std::optional<int> rightSlot = stackSlot(expr->right);
+    auto *literal = dynamic_cast<Literal *>(expr->right);
+    std::optional<Value> constant;
+    if (literal != nullptr && literal->value.isNumber()) {
+      constant = literal->value;
+    }
+
+    if (leftSlot && rightSlot) {
+      return [this, op, apply, a = *leftSlot, b = *rightSlot] {
+        return apply(op, stack[frame + a], stack[frame + b]);
+      };
+    }
+    if (leftSlot && constant) {
+      return [this, op, apply, a = *leftSlot, b = *constant] {
+        return apply(op, stack[frame + a], b);
+      };
+    }
+
+    Eval left = compile(expr->left);
+    if (constant) {
+      return [op, apply, left, b = *constant] { return apply(op, left(), b); };
+    }
+
+    Eval right = compile(expr->right);
+    return [op, apply, left, right] {
+      Value a = left();
+      return apply(op, a, right());
+    };
+  }
+
+  // The frame slot of `expr` if it reads a local on the value stack
+  static std::optional<int> stackSlot(Expr *expr) {
+    auto *variable = dynamic_cast<Variable *>(expr);
+    if (variable == nullptr || !variable->binding.onStack) {
+      return std::nullopt;
+    }
+    return variable->binding.slot;
+  }
+
+  Exec define(const Token &name, const Binding &binding, Eval value) {
+    if (binding.onStack) {
+      // Locals are declared in slot order
+      return [this, value] { stack.push_back(value()); };
+    }
+    if (binding.isLocal()) {
+      return [this, value] { environment->define(value()); };
+    }
+
+    return [this, value, slot = globals.slot(name.symbol())] {
+      globals.define(slot, value());
+    };
+  }
+
+  void executeBlock(const std::vector<Exec> &statements,
+                    std::shared_ptr<Environment> env) {
+    std::shared_ptr<Environment> previous = std::move(this->environment);
+    this->environment = std::move(env);
+    executeStatements(statements);
+    this->environment = std::move(previous);
+  }
+
+  void executeStatements(const std::vector<Exec> &statements) {
+    for (const Exec &statement : statements) {
+      statement();
+      if (returning) {
+        break;
+      }
+    }
+  }
+
+  // Checks that `callee` can be called with `count` arguments
+  static ClosureFunction *callable(const Token &paren, const Value &callee,
+                                   size_t count) {
+    if (!callee.isObjType(ObjType::CLOSURE_FUNCTION)) {
+      throw RuntimeError{paren, "Can only call functions and classes."};
+    }
+    auto *function = callee.asObj<ClosureFunction>();
+
+    if (count != function->code->arity) {
+      throw RuntimeError{paren,
+                         "Expected " + std::to_string(function->code->arity) +
+                             " arguments but got " + std::to_string(count) +
+                             "."};
+    }
+    return function;
+  }
+
+  // Calls the function with the arguments on the stack from `base` up, which
+  // become the first slots of its frame
+  Value call(const Token &paren, const Value &callee, size_t base) {
+    ClosureFunction *function =
+        callable(paren, callee, stack.size() - base);
+    // Keeps the function a tail call replaced this one with alive
+    Value tailFunction;
+    Value result;
+
+    size_t previousFrame = frame;
+    frame = base;
+
+    for (;;) {
+      std::optional<Profiler::Call> profile;
+      if (profiler != nullptr) {
+        profile.emplace(*profiler, function->code.get(), function->code->name,
+                        function->code->line);
+      }
+
+      if (function->code->captured) {
+        auto env = Environment::make(function->closure);
+        for (size_t i = frame; i < stack.size(); i++) {
+          env->define(std::move(stack[i]));
+        }
+        stack.resize(frame);
+        executeBlock(function->code->body, std::move(env));
+      } else {
+        executeBlock(function->code->body, function->closure);
+      }
+      stack.resize(frame);
+
+      if (!returning) {
+        break;
+      }
+      returning = false;
+
+      if (tailCallee.isNil()) {
+        result = std::move(returnValue);
+        break;
+      }
+      tailFunction = std::move(tailCallee);
+      function = tailFunction.asObj<ClosureFunction>();
+      for (Value &argument : tailArguments) {
+        stack.push_back(std::move(argument));
+      }
+    }
+
+    frame = previousFrame;
+    return result;
+  }
+
+  // Passes the arguments on the stack from `base` up to the native in place,
+  // then pops them
+  Value callNative(const Token &paren, const Value &callee, size_t base) {
+    Value result;
+    try {
+      result = callee.asObj<NativeFunction>()->invoke(
+          std::span{stack}.subspan(base));
+    } catch (const NativeError &error) {
+      throw RuntimeError{paren, error.what()};
+    }
+    stack.resize(base);
+    return result;
+  }
+
+  static void checkNumberOperand(const Token &op, const Value &operand) {
+    if (operand.isNumber()) {
+      return;
+    }
+
+    throw RuntimeError(op, "Operand must be a number.");
+  }
+
+  static void checkNumberOperands(const Token &op, const Value &left,
+                                  const Value &right) {
+    if (left.isNumber() && right.isNumber()) {
+      return;
+    }
+
+    throw RuntimeError(op, "Operands must be a number.");
+  }
+};
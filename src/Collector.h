@@ -0,0 +1,204 @@
+#pragma once
+
+#include "Obj.h"
+#include "Value.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+// A runtime object that holds references to other runtime objects, and so can
+// be part of a reference cycle: Environments, and the functions, closures and
+// upvalues that hold on to them. Reference counting frees everything else as
+// soon as it becomes garbage; the Collector finds the cycles among these.
+class Traced {
+  friend class Collector;
+
+  // Every live Traced object, in a list threaded through the objects
+  Traced *previous = nullptr;
+  Traced *next = nullptr;
+  // Scratch space for Collector::collect()
+  std::int64_t externalReferences = 0;
+  bool reachable = false;
+
+protected:
+  Traced();
+  ~Traced();
+
+public:
+  Traced(const Traced &) = delete;
+  Traced &operator=(const Traced &) = delete;
+
+  using Visit = std::function<void(Traced *)>;
+
+  // Number of strong references to this object, from anywhere
+  [[nodiscard]] virtual std::int64_t references() const = 0;
+  // Calls `visit` once for every strong reference this object holds to
+  // another Traced object
+  virtual void trace(const Visit &visit) const = 0;
+  // Drops every reference this object holds, to break the cycle it is in
+  virtual void clear() = 0;
+  // A strong reference that keeps this object alive while it is cleared
+  virtual std::shared_ptr<void> keepAlive() = 0;
+
+  // For Obj subclasses: a Value holding the object
+  static std::shared_ptr<void> keepAlive(Obj *obj) {
+    return std::make_shared<Value>(obj);
+  }
+
+  static void trace(const Value &value, const Visit &visit) {
+    if (value.isObj()) {
+      if (auto *traced = dynamic_cast<Traced *>(value.asObj<Obj>())) {
+        visit(traced);
+      }
+    }
+  }
+};
+
+// Cycle collector for Traced objects, run every time the number of live ones
+// has grown by a configurable factor since the last collection.
+//
+// The roots are found rather than listed: a Traced object is reachable if
+// something other than another Traced object refers to it, whether that is a
+// global, a value stack, the current Environment or a C++ local in the middle
+// of an evaluation. Everything the roots don't reach is garbage, held only by
+// reference cycles; the collector clears those objects' references, which
+// lets reference counting free them.
+class Collector {
+  friend class Traced;
+
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Statistics {
+    std::uint64_t collections = 0;
+    std::uint64_t freed = 0;
+    Clock::duration totalPause{};
+    Clock::duration longestPause{};
+
+    void report(std::ostream &out) const {
+      using Milliseconds = std::chrono::duration<double, std::milli>;
+      out << "gc: " << collections << " collections, " << freed
+          << " objects freed, " << Milliseconds{totalPause}.count()
+          << " ms total pause, " << Milliseconds{longestPause}.count()
+          << " ms longest pause\n";
+    }
+  };
+
+private:
+  static constexpr size_t MINIMUM_THRESHOLD = 1024;
+
+  Traced *objects = nullptr;
+  size_t live = 0;
+  // Collect once `live` reaches this
+  size_t threshold = MINIMUM_THRESHOLD;
+  bool collecting = false;
+
+public:
+  // How much the number of live Traced objects may grow, relative to the
+  // number that survived the last collection, before the next one
+  double growth = 2.0;
+  // Where collections are counted: the statistics of the Lox instance running
+  // on this thread, if it keeps any
+  Statistics *statistics = nullptr;
+
+  // Trivially destructible, so objects freed during static destruction can
+  // still leave it
+  static Collector &local() {
+    thread_local Collector collector;
+    return collector;
+  }
+
+  void collect() {
+    collecting = true;
+    Clock::time_point start = Clock::now();
+
+    // References from outside the Traced objects make an object a root
+    for (Traced *object = objects; object != nullptr; object = object->next) {
+      object->externalReferences = object->references();
+      object->reachable = false;
+    }
+    for (Traced *object = objects; object != nullptr; object = object->next) {
+      object->trace([](Traced *child) { child->externalReferences--; });
+    }
+
+    std::vector<Traced *> pending;
+    for (Traced *object = objects; object != nullptr; object = object->next) {
+      if (object->externalReferences > 0) {
+        object->reachable = true;
+        pending.push_back(object);
+      }
+    }
+    while (!pending.empty()) {
+      Traced *object = pending.back();
+      pending.pop_back();
+      object->trace([&pending](Traced *child) {
+        if (!child->reachable) {
+          child->reachable = true;
+          pending.push_back(child);
+        }
+      });
+    }
+
+    // Keep the garbage alive until every cycle is broken, then let it go
+    std::vector<Traced *> garbage;
+    std::vector<std::shared_ptr<void>> keepAlive;
+    for (Traced *object = objects; object != nullptr; object = object->next) {
+      if (!object->reachable) {
+        garbage.push_back(object);
+        keepAlive.push_back(object->keepAlive());
+      }
+    }
+    for (Traced *object : garbage) {
+      object->clear();
+    }
+    keepAlive.clear();
+
+    threshold = std::max(MINIMUM_THRESHOLD,
+                         static_cast<size_t>(static_cast<double>(live) * growth));
+
+    if (statistics != nullptr) {
+      Clock::duration pause = Clock::now() - start;
+      statistics->collections++;
+      statistics->freed += garbage.size();
+      statistics->totalPause += pause;
+      statistics->longestPause = std::max(statistics->longestPause, pause);
+    }
+    collecting = false;
+  }
+
+private:
+  void track(Traced *object) {
+    // Collect before the new object joins the list, since it isn't fully
+    // constructed yet
+    if (live >= threshold && !collecting) {
+      collect();
+    }
+
+    object->next = objects;
+    if (objects != nullptr) {
+      objects->previous = object;
+    }
+    objects = object;
+    live++;
+  }
+
+  void untrack(Traced *object) {
+    if (object->previous != nullptr) {
+      object->previous->next = object->next;
+    } else {
+      objects = object->next;
+    }
+    if (object->next != nullptr) {
+      object->next->previous = object->previous;
+    }
+    live--;
+  }
+};
+
+inline Traced::Traced() { Collector::local().track(this); }
+
+inline Traced::~Traced() { Collector::local().untrack(this); }
@@ -0,0 +1,519 @@
+#pragma once
+
+#include "Chunk.h"
+#include "Error.h"
+#include "Expr.h"
+#include "Globals.h"
+#include "ObjFunction.h"
+#include "StackDepth.h"
+#include "Stmt.h"
+#include "SymbolTable.h"
+#include "Value.h"
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Compiles a resolved syntax tree into bytecode for the VM.
+// Locals live in VM stack slots and are captured by closures through
+// upvalues, so the Compiler tracks its own scopes rather than using the
+// Environment slots assigned by the Resolver. The Resolver's bindings are
+// still used to tell globals apart from locals.
+class Compiler : public ExprVisitor, public StmtVisitor {
+  static constexpr int MAX_LOCALS =
+      std::numeric_limits<std::uint8_t>::max() + 1;
+  static constexpr int MAX_UPVALUES = MAX_LOCALS;
+
+  struct Local {
+    Symbol name;
+    int depth;
+    bool isCaptured;
+  };
+
+  struct Upvalue {
+    std::uint8_t index;
+    bool isLocal;
+  };
+
+  // Compilation state for the function currently being compiled. Nested
+  // function declarations push a new FunctionState linked to the enclosing one.
+  struct FunctionState {
+    FunctionState *enclosing;
+    Value function;
+    std::vector<Local> locals;
+    std::vector<Upvalue> upvalues;
+    int scopeDepth = 0;
+
+    FunctionState(FunctionState *enclosing, Value function)
+        : enclosing{enclosing}, function{std::move(function)} {}
+
+    [[nodiscard]] ObjFunction *getFunction() const {
+      return function.asObj<ObjFunction>();
+    }
+  };
+
+  FunctionState *current = nullptr;
+  int line = 1;
+  // The VM's globals, where each global name gets its slot
+  Globals &globals;
+  ErrorReporter &errors;
+
+public:
+  Compiler(Globals &globals, ErrorReporter &errors)
+      : globals{globals}, errors{errors} {}
+
+  // Returns the top-level script as an ObjFunction, or nil on a compile error
+  Value compile(std::span<Stmt *const> statements) {
+    FunctionState script{nullptr, Value{new ObjFunction{""}}};
+    beginFunction(script);
+
+    for (Stmt *statement : statements) {
+      compile(statement);
+    }
+
+    emitReturn();
+    checkStack(*script.getFunction());
+    current = nullptr;
+
+    if (errors.hadError) {
+      return nullptr;
+    }
+    return script.function;
+  }
+
+  // Statements
+  void visitBlockStmt(Block *stmt) override {
+    beginScope();
+    for (Stmt *statement : stmt->statements) {
+      compile(statement);
+    }
+    endScope();
+  }
+
+  void visitExpressionStmt(Expression *stmt) override {
+    compile(stmt->expression);
+    emitByte(OP_POP);
+  }
+
+  void visitFunctionStmt(Function *stmt) override {
+    line = stmt->name.line;
+    if (current->scopeDepth > 0) {
+      // Declared before the body is compiled so the function can refer to
+      // itself recursively.
+      addLocal(stmt->name.symbol());
+    }
+
+    function(stmt);
+
+    if (current->scopeDepth == 0) {
+      line = stmt->name.line;
+      emitGlobal(OP_DEFINE_GLOBAL, stmt->name.symbol());
+    }
+  }
+
+  void visitIfStmt(If *stmt) override {
+    compile(stmt->condition);
+
+    size_t thenJump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP);
+    compile(stmt->thenBranch);
+
+    size_t elseJump = emitJump(OP_JUMP);
+    patchJump(thenJump);
+    emitByte(OP_POP);
+
+    if (stmt->elseBranch != nullptr) {
+      compile(stmt->elseBranch);
+    }
+    patchJump(elseJump);
+  }
+
+  void visitPrintStmt(Print *stmt) override {
+    compile(stmt->expression);
+    emitByte(OP_PRINT);
+  }
+
+  void visitReturnStmt(Return *stmt) override {
+    line = stmt->keyword.line;
+    if (stmt->tail) {
+      // Returns whatever the callee returns, from the callee's own frame
+      compileCall(static_cast<Call *>(stmt->value), OP_TAIL_CALL);
+      return;
+    }
+
+    if (stmt->value == nullptr) {
+      emitByte(OP_NIL);
+    } else {
+      compile(stmt->value);
+    }
+    emitByte(OP_RETURN);
+  }
+
+  void visitVarStmt(Var *stmt) override {
+    if (stmt->initializer == nullptr) {
+      line = stmt->name.line;
+      emitByte(OP_NIL);
+    } else {
+      compile(stmt->initializer);
+    }
+
+    line = stmt->name.line;
+    if (current->scopeDepth > 0) {
+      // The initializer's value is already sitting in the new local's slot
+      addLocal(stmt->name.symbol());
+    } else {
+      emitGlobal(OP_DEFINE_GLOBAL, stmt->name.symbol());
+    }
+  }
+
+  void visitWhileStmt(While *stmt) override {
+    size_t loopStart = currentChunk().code.size();
+    compile(stmt->condition);
+
+    size_t exitJump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP);
+    compile(stmt->body);
+    emitLoop(loopStart);
+
+    patchJump(exitJump);
+    emitByte(OP_POP);
+  }
+
+  // Expressions
+  Value visitAssignExpr(Assign *expr) override {
+    compile(expr->value);
+    line = expr->name.line;
+    namedVariable(expr->name, expr->binding, true);
+    return {};
+  }
+
+  Value visitBinaryExpr(Binary *expr) override {
+    compile(expr->left);
+    compile(expr->right);
+
+    line = expr->op.line;
+    switch (expr->op.type) {
+    case BANG_EQUAL:
+      emitByte(OP_NOT_EQUAL);
+      break;
+    case EQUAL_EQUAL:
+      emitByte(OP_EQUAL);
+      break;
+    case GREATER:
+      emitByte(OP_GREATER);
+      break;
+    case GREATER_EQUAL:
+      emitByte(OP_GREATER_EQUAL);
+      break;
+    case LESS:
+      emitByte(OP_LESS);
+      break;
+    case LESS_EQUAL:
+      emitByte(OP_LESS_EQUAL);
+      break;
+    case MINUS:
+      emitByte(OP_SUBTRACT);
+      break;
+    case PLUS:
+      emitByte(OP_ADD);
+      break;
+    case SLASH:
+      emitByte(OP_DIVIDE);
+      break;
+    case STAR:
+      emitByte(OP_MULTIPLY);
+      break;
+    default:
+      // Unreachable
+      break;
+    }
+    return {};
+  }
+
+  Value visitCallExpr(Call *expr) override {
+    compileCall(expr, OP_CALL);
+    return {};
+  }
+
+  Value visitGroupingExpr(Grouping *expr) override {
+    compile(expr->expression);
+    return {};
+  }
+
+  Value visitLiteralExpr(Literal *expr) override {
+    const Value &value = expr->value;
+    if (value.isNil()) {
+      emitByte(OP_NIL);
+    } else if (value.isBool()) {
+      emitByte(value.asBool() ? OP_TRUE : OP_FALSE);
+    } else {
+      emitConstant(value);
+    }
+    return {};
+  }
+
+  Value visitLogicalExpr(Logical *expr) override {
+    compile(expr->left);
+
+    line = expr->op.line;
+    if (expr->op.type == OR) {
+      size_t elseJump = emitJump(OP_JUMP_IF_FALSE);
+      size_t endJump = emitJump(OP_JUMP);
+
+      patchJump(elseJump);
+      emitByte(OP_POP);
+      compile(expr->right);
+      patchJump(endJump);
+    } else {
+      size_t endJump = emitJump(OP_JUMP_IF_FALSE);
+
+      emitByte(OP_POP);
+      compile(expr->right);
+      patchJump(endJump);
+    }
+    return {};
+  }
+
+  Value visitUnaryExpr(Unary *expr) override {
+    compile(expr->right);
+
+    line = expr->op.line;
+    emitByte(expr->op.type == MINUS ? OP_NEGATE : OP_NOT);
+    return {};
+  }
+
+  Value visitVariableExpr(Variable *expr) override {
+    line = expr->name.line;
+    namedVariable(expr->name, expr->binding, false);
+    return {};
+  }
+
+private:
+  void compile(Stmt *stmt) { stmt->accept(*this); }
+
+  void compile(Expr *expr) { expr->accept(*this); }
+
+  // `op` is OP_CALL or OP_TAIL_CALL
+  void compileCall(Call *expr, OpCode op) {
+    compile(expr->callee);
+    for (Expr *argument : expr->arguments) {
+      compile(argument);
+    }
+
+    line = expr->paren.line;
+    emitBytes(op, static_cast<std::uint8_t>(expr->arguments.size()));
+  }
+
+  void function(Function *stmt) {
+    FunctionState state{current,
+                        Value{new ObjFunction{std::string{stmt->name.lexeme}}}};
+    beginFunction(state);
+    beginScope();
+
+    for (const Token &param : stmt->params) {
+      state.getFunction()->arity++;
+      addLocal(param.symbol());
+    }
+
+    for (Stmt *statement : stmt->body) {
+      compile(statement);
+    }
+
+    emitReturn();
+    checkStack(*state.getFunction());
+    current = state.enclosing;
+
+    ObjFunction *function = state.getFunction();
+    function->upvalueCount = static_cast<int>(state.upvalues.size());
+
+    line = stmt->name.line;
+    emitOp(OP_CLOSURE, makeConstant(state.function));
+    for (const Upvalue &upvalue : state.upvalues) {
+      emitBytes(upvalue.isLocal ? 1 : 0, upvalue.index);
+    }
+  }
+
+  void beginFunction(FunctionState &state) {
+    current = &state;
+    // Slot zero holds the function being called
+    state.locals.push_back(Local{symbols.intern(""), 0, false});
+  }
+
+  void beginScope() { current->scopeDepth++; }
+
+  void endScope() {
+    current->scopeDepth--;
+
+    std::vector<Local> &locals = current->locals;
+    while (!locals.empty() && locals.back().depth > current->scopeDepth) {
+      emitByte(locals.back().isCaptured ? OP_CLOSE_UPVALUE : OP_POP);
+      locals.pop_back();
+    }
+  }
+
+  void addLocal(Symbol name) {
+    if (current->locals.size() == MAX_LOCALS) {
+      errors.error(line, "Too many local variables in function.");
+      return;
+    }
+
+    current->locals.push_back(Local{name, current->scopeDepth, false});
+  }
+
+  void namedVariable(const Token &name, const Binding &binding, bool assign) {
+    // The Resolver already knows which names are globals
+    if (!binding.isLocal()) {
+      emitGlobal(assign ? OP_SET_GLOBAL : OP_GET_GLOBAL, name.symbol());
+      return;
+    }
+
+    int arg = resolveLocal(*current, name.symbol());
+    if (arg != -1) {
+      emitBytes(assign ? OP_SET_LOCAL : OP_GET_LOCAL,
+                static_cast<std::uint8_t>(arg));
+      return;
+    }
+
+    arg = resolveUpvalue(*current, name.symbol());
+    emitBytes(assign ? OP_SET_UPVALUE : OP_GET_UPVALUE,
+              static_cast<std::uint8_t>(arg));
+  }
+
+  static int resolveLocal(FunctionState &state, Symbol name) {
+    for (int i = static_cast<int>(state.locals.size()) - 1; i > 0; i--) {
+      if (state.locals[i].name == name) {
+        return i;
+      }
+    }
+
+    return -1;
+  }
+
+  int resolveUpvalue(FunctionState &state, Symbol name) {
+    if (state.enclosing == nullptr) {
+      return -1;
+    }
+
+    int local = resolveLocal(*state.enclosing, name);
+    if (local != -1) {
+      state.enclosing->locals[local].isCaptured = true;
+      return addUpvalue(state, static_cast<std::uint8_t>(local), true);
+    }
+
+    int upvalue = resolveUpvalue(*state.enclosing, name);
+    if (upvalue != -1) {
+      return addUpvalue(state, static_cast<std::uint8_t>(upvalue), false);
+    }
+
+    return -1;
+  }
+
+  int addUpvalue(FunctionState &state, std::uint8_t index, bool isLocal) {
+    for (size_t i = 0; i < state.upvalues.size(); i++) {
+      const Upvalue &upvalue = state.upvalues[i];
+      if (upvalue.index == index && upvalue.isLocal == isLocal) {
+        return static_cast<int>(i);
+      }
+    }
+
+    if (state.upvalues.size() == MAX_UPVALUES) {
+      errors.error(line, "Too many closure variables in function.");
+      return 0;
+    }
+
+    state.upvalues.push_back(Upvalue{index, isLocal});
+    return static_cast<int>(state.upvalues.size()) - 1;
+  }
+
+  // Bytecode emission
+  Chunk &currentChunk() { return current->getFunction()->chunk; }
+
+  // Keeps the function within the stack slots the VM sets aside for a frame
+  void checkStack(const ObjFunction &function) {
+    // Code after an error may be incomplete
+    if (errors.hadError) {
+      return;
+    }
+
+    std::optional<StackDepth::Result> depth = StackDepth::measure(function);
+    assert(depth && "the compiler's code misuses the stack");
+    if (depth && depth->max > StackDepth::FRAME_SLOTS) {
+      errors.error(function.chunk.lines[depth->offset],
+                   "Too many values on the stack in function.");
+    }
+  }
+
+  void emitByte(std::uint8_t byte) { currentChunk().write(byte, line); }
+
+  void emitBytes(std::uint8_t byte1, std::uint8_t byte2) {
+    emitByte(byte1);
+    emitByte(byte2);
+  }
+
+  void emitShort(std::uint16_t value) {
+    emitBytes(static_cast<std::uint8_t>(value >> 8),
+              static_cast<std::uint8_t>(value & 0xff));
+  }
+
+  void emitOp(std::uint8_t op, std::uint16_t operand) {
+    emitByte(op);
+    emitShort(operand);
+  }
+
+  void emitReturn() {
+    emitByte(OP_NIL);
+    emitByte(OP_RETURN);
+  }
+
+  void emitConstant(Value value) {
+    emitOp(OP_CONSTANT, makeConstant(std::move(value)));
+  }
+
+  std::uint16_t makeConstant(Value value) {
+    size_t constant = currentChunk().addConstant(std::move(value));
+    if (constant > std::numeric_limits<std::uint16_t>::max()) {
+      errors.error(line, "Too many constants in one chunk.");
+      return 0;
+    }
+
+    return static_cast<std::uint16_t>(constant);
+  }
+
+  void emitGlobal(std::uint8_t op, Symbol name) {
+    auto slot = static_cast<std::uint32_t>(globals.slot(name));
+    emitByte(op);
+    emitShort(static_cast<std::uint16_t>(slot >> 16));
+    emitShort(static_cast<std::uint16_t>(slot & 0xffff));
+  }
+
+  size_t emitJump(std::uint8_t instruction) {
+    emitByte(instruction);
+    emitShort(0xffff);
+    return currentChunk().code.size() - 2;
+  }
+
+  void patchJump(size_t offset) {
+    // -2 to adjust for the bytecode for the jump offset itself
+    size_t jump = currentChunk().code.size() - offset - 2;
+    if (jump > std::numeric_limits<std::uint16_t>::max()) {
+      errors.error(line, "Too much code to jump over.");
+    }
+
+    currentChunk().code[offset] = static_cast<std::uint8_t>((jump >> 8) & 0xff);
+    currentChunk().code[offset + 1] = static_cast<std::uint8_t>(jump & 0xff);
+  }
+
+  void emitLoop(size_t loopStart) {
+    emitByte(OP_LOOP);
+
+    size_t offset = currentChunk().code.size() - loopStart + 2;
+    if (offset > std::numeric_limits<std::uint16_t>::max()) {
+      errors.error(line, "Loop body too large.");
+    }
+
+    emitShort(static_cast<std::uint16_t>(offset));
+  }
+};
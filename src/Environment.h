@@ -1,67 +1,106 @@
 #pragma once
 
-#include "RuntimeError.h"
-#include "Token.h"
-#include <any>
-#include <map>
+#include "Collector.h"
+#include "PoolAllocator.h"
+#include "Value.h"
+#include <array>
+#include <cstdint>
+#include <iterator> // std::make_move_iterator
 #include <memory>
-#include <string>
 #include <utility>
+#include <vector>
+
+// A local scope. Variables are stored in declaration order, so the slot index
+// the Resolver assigns to each local is its position in `values`.
+//
+// Environments are created for every block entered and every call made, so
+// they are allocated with make() from a pool, and the first few variables are
+// stored inline. Entering a scope with at most INLINE_SLOTS variables then
+// takes no allocation once the pool has warmed up, and a scope no closure
+// captured goes back to the pool as soon as it is left.
+//
+// An Environment and a function declared in it refer to each other, so the
+// Collector traces them.
+class Environment : public Traced,
+                    public std::enable_shared_from_this<Environment> {
+  static constexpr size_t INLINE_SLOTS = 8;
 
-class Environment : public std::enable_shared_from_this<Environment> {
   std::shared_ptr<Environment> enclosing;
-  std::map<std::string, std::any> values;
+  // Declared before `values`, which is initialized to point at it
+  std::array<Value, INLINE_SLOTS> inlineValues;
+  // Points at inlineValues, or at spilled once there are more variables than
+  // fit inline
+  Value *values;
+  size_t count = 0;
+  std::vector<Value> spilled;
 
 public:
-  Environment() : enclosing{nullptr} {}
+  Environment() : enclosing{nullptr}, values{inlineValues.data()} {}
 
   Environment(std::shared_ptr<Environment> enclosing)
-      : enclosing{std::move(enclosing)} {}
+      : enclosing{std::move(enclosing)}, values{inlineValues.data()} {}
 
-  std::any get(const Token &name) {
-    if (values.contains(name.lexeme)) {
-      return values[name.lexeme];
-    }
+  // `values` points into the Environment itself
+  Environment(const Environment &) = delete;
+  Environment &operator=(const Environment &) = delete;
+
+  static std::shared_ptr<Environment>
+  make(std::shared_ptr<Environment> enclosing) {
+    return std::allocate_shared<Environment>(PoolAllocator<Environment>{},
+                                             std::move(enclosing));
+  }
 
+  [[nodiscard]] std::int64_t references() const override {
+    return weak_from_this().use_count();
+  }
+
+  void trace(const Visit &visit) const override {
     if (enclosing != nullptr) {
-      return enclosing->get(name);
+      visit(enclosing.get());
+    }
+    for (size_t i = 0; i < count; i++) {
+      Traced::trace(values[i], visit);
     }
-
-    throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
   }
 
-  void assign(const Token &name, std::any value) {
-    if (values.contains(name.lexeme)) {
-      values[name.lexeme] = std::move(value);
-      return;
+  void clear() override {
+    enclosing = nullptr;
+    for (size_t i = 0; i < count; i++) {
+      values[i] = nullptr;
     }
+  }
 
-    if (enclosing != nullptr) {
-      enclosing->assign(name, std::move(value));
+  std::shared_ptr<void> keepAlive() override { return shared_from_this(); }
+
+  void define(Value value) {
+    if (count < INLINE_SLOTS) {
+      inlineValues[count++] = std::move(value);
       return;
     }
 
-    throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
-  }
-
-  void define(const std::string &name, std::any value) {
-    values[name] = std::move(value);
+    if (count == INLINE_SLOTS) {
+      spilled.assign(std::make_move_iterator(inlineValues.begin()),
+                     std::make_move_iterator(inlineValues.end()));
+    }
+    spilled.push_back(std::move(value));
+    values = spilled.data();
+    count++;
   }
 
-  std::shared_ptr<Environment> ancestor(int distance) {
-    std::shared_ptr<Environment> environment = shared_from_this();
+  Environment *ancestor(int distance) {
+    Environment *environment = this;
     for (int i = 0; i < distance; i++) {
-      environment = environment->enclosing;
+      environment = environment->enclosing.get();
     }
 
     return environment;
   }
 
-  std::any getAt(int distance, const std::string &name) {
-    return ancestor(distance)->values[name];
+  const Value &getAt(int distance, int slot) {
+    return ancestor(distance)->values[slot];
   }
 
-  void assignAt(int distance, const Token &name, std::any value) {
-    ancestor(distance)->values[name.lexeme] = std::move(value);
+  void assignAt(int distance, int slot, Value value) {
+    ancestor(distance)->values[slot] = std::move(value);
   }
 };
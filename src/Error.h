@@ -2,31 +2,43 @@
 
 #include "RuntimeError.h"
 #include "Token.h"
-#include <iostream>
+#include <ostream>
+#include <string>
 #include <string_view>
 
-inline bool hadError = false;
-inline bool hadRuntimeError = false;
+// Reports the errors of one Lox instance and records whether there were any.
+// Every stage of a run reports to its instance's ErrorReporter, so instances
+// running side by side keep their errors and exit statuses apart.
+class ErrorReporter {
+  std::ostream &err;
 
-inline void report(int line, std::string_view where, std::string_view message) {
-  std::cerr << "[line " << line << "] Error" << where << ": " << message
-            << '\n';
-  hadError = true;
-}
+public:
+  bool hadError = false;
+  bool hadRuntimeError = false;
 
-inline void error(const Token &token, std::string_view message) {
-  if (token.type == END_OF_FILE) {
-    report(token.line, " at end", message);
-  } else {
-    report(token.line, " at '" + token.lexeme + "'", message);
+  ErrorReporter(std::ostream &err) : err{err} {}
+
+  void report(int line, std::string_view where, std::string_view message) {
+    err << "[line " << line << "] Error" << where << ": " << message << '\n';
+    hadError = true;
+  }
+
+  void error(const Token &token, std::string_view message) {
+    if (token.type == END_OF_FILE) {
+      report(token.line, " at end", message);
+    } else {
+      report(token.line, " at '" + std::string{token.lexeme} + "'", message);
+    }
   }
-}
 
-inline void error(int line, std::string_view message) {
-  report(line, "", message);
-}
+  void error(int line, std::string_view message) { report(line, "", message); }
 
-inline void runtimeError(const RuntimeError &error) {
-  std::cerr << error.what() << "\n[line " << error.token.line << "]\n";
-  hadRuntimeError = true;
-}
+  void runtimeError(int line, std::string_view message) {
+    err << message << "\n[line " << line << "]\n";
+    hadRuntimeError = true;
+  }
+
+  void runtimeError(const RuntimeError &error) {
+    runtimeError(error.token.line, error.what());
+  }
+};
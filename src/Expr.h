@@ -1,11 +1,11 @@
 // GenerateAst.cpp > defineAst()
 #pragma once
 
+#include "Binding.h"
 #include "Token.h"
-#include <any>
-#include <memory>  // std::shared_ptr
+#include "Value.h"
+#include <span>
 #include <utility> // std::move
-#include <vector>
 
 struct Assign;
 struct Binary;
@@ -18,117 +18,120 @@ struct Variable;
 
 // GenerateAst.cpp > defineVisitor()
 struct ExprVisitor {
-  virtual std::any visitAssignExpr(std::shared_ptr<Assign> expr) = 0;
-  virtual std::any visitBinaryExpr(std::shared_ptr<Binary> expr) = 0;
-  virtual std::any visitCallExpr(std::shared_ptr<Call> expr) = 0;
-  virtual std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) = 0;
-  virtual std::any visitLiteralExpr(std::shared_ptr<Literal> expr) = 0;
-  virtual std::any visitLogicalExpr(std::shared_ptr<Logical> expr) = 0;
-  virtual std::any visitUnaryExpr(std::shared_ptr<Unary> expr) = 0;
-  virtual std::any visitVariableExpr(std::shared_ptr<Variable> expr) = 0;
+  virtual Value visitAssignExpr(Assign *expr) = 0;
+  virtual Value visitBinaryExpr(Binary *expr) = 0;
+  virtual Value visitCallExpr(Call *expr) = 0;
+  virtual Value visitGroupingExpr(Grouping *expr) = 0;
+  virtual Value visitLiteralExpr(Literal *expr) = 0;
+  virtual Value visitLogicalExpr(Logical *expr) = 0;
+  virtual Value visitUnaryExpr(Unary *expr) = 0;
+  virtual Value visitVariableExpr(Variable *expr) = 0;
 
   virtual ~ExprVisitor() = default;
 };
 
 struct Expr {
-  virtual std::any accept(ExprVisitor &visitor) = 0;
+  virtual Value accept(ExprVisitor &visitor) = 0;
   virtual ~Expr() = default;
 };
 
 // GenerateAst.cpp > defineType()
-struct Assign : Expr, public std::enable_shared_from_this<Assign> {
-  Assign(Token name, std::shared_ptr<Expr> value)
-      : name{std::move(name)}, value{std::move(value)} {}
+struct Assign : Expr {
+  Assign(Token name, Expr *value)
+      : name{std::move(name)}, value{value} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitAssignExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitAssignExpr(this);
   }
 
   const Token name;
-  const std::shared_ptr<Expr> value;
+  Expr *const value;
+  Binding binding{};
 };
 
-struct Binary : Expr, public std::enable_shared_from_this<Binary> {
-  Binary(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-      : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
+struct Binary : Expr {
+  Binary(Expr *left, Token op, Expr *right)
+      : left{left}, op{std::move(op)}, right{right} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitBinaryExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitBinaryExpr(this);
   }
 
-  const std::shared_ptr<Expr> left;
+  Expr *const left;
   const Token op;
-  const std::shared_ptr<Expr> right;
+  Expr *const right;
 };
 
-struct Call : Expr, public std::enable_shared_from_this<Call> {
-  Call(std::shared_ptr<Expr> callee, Token paren, std::vector<std::shared_ptr<Expr>> arguments)
-      : callee{std::move(callee)}, paren{std::move(paren)}, arguments{std::move(arguments)} {}
+struct Call : Expr {
+  Call(Expr *callee, Token paren, std::span<Expr *const> arguments)
+      : callee{callee}, paren{std::move(paren)}, arguments{arguments} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitCallExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitCallExpr(this);
   }
 
-  const std::shared_ptr<Expr> callee;
+  Expr *const callee;
   const Token paren;
-  const std::vector<std::shared_ptr<Expr>> arguments;
+  const std::span<Expr *const> arguments;
 };
 
-struct Grouping : Expr, public std::enable_shared_from_this<Grouping> {
-  Grouping(std::shared_ptr<Expr> expression)
-      : expression{std::move(expression)} {}
+struct Grouping : Expr {
+  Grouping(Expr *expression)
+      : expression{expression} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitGroupingExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitGroupingExpr(this);
   }
 
-  const std::shared_ptr<Expr> expression;
+  Expr *const expression;
 };
 
-struct Literal : Expr, public std::enable_shared_from_this<Literal> {
-  Literal(std::any value)
-      : value{std::move(value)} {}
+struct Literal : Expr {
+  Literal(Value value, int line)
+      : value{std::move(value)}, line{std::move(line)} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitLiteralExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitLiteralExpr(this);
   }
 
-  const std::any value;
+  const Value value;
+  const int line;
 };
 
-struct Logical : Expr, public std::enable_shared_from_this<Logical> {
-  Logical(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-      : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
+struct Logical : Expr {
+  Logical(Expr *left, Token op, Expr *right)
+      : left{left}, op{std::move(op)}, right{right} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitLogicalExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitLogicalExpr(this);
   }
 
-  const std::shared_ptr<Expr> left;
+  Expr *const left;
   const Token op;
-  const std::shared_ptr<Expr> right;
+  Expr *const right;
 };
 
-struct Unary : Expr, public std::enable_shared_from_this<Unary> {
-  Unary(Token op, std::shared_ptr<Expr> right)
-      : op{std::move(op)}, right{std::move(right)} {}
+struct Unary : Expr {
+  Unary(Token op, Expr *right)
+      : op{std::move(op)}, right{right} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitUnaryExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitUnaryExpr(this);
   }
 
   const Token op;
-  const std::shared_ptr<Expr> right;
+  Expr *const right;
 };
 
-struct Variable : Expr, public std::enable_shared_from_this<Variable> {
+struct Variable : Expr {
   Variable(Token name)
       : name{std::move(name)} {}
 
-  std::any accept(ExprVisitor &visitor) override {
-    return visitor.visitVariableExpr(shared_from_this());
+  Value accept(ExprVisitor &visitor) override {
+    return visitor.visitVariableExpr(this);
   }
 
   const Token name;
+  Binding binding{};
 };
 
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "RuntimeError.h"
+#include "SymbolTable.h"
+#include "Token.h"
+#include "Value.h"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Top-level variables. These are not resolved statically (a global may be
+// referenced before it is declared), but every name is given a slot the first
+// time it is seen, defined or not. Slots are never reused, so a slot found once
+// stays valid for the life of the table, through later definitions and REPL
+// redefinitions alike, and callers can cache it.
+class Globals {
+  struct Global {
+    Value value;
+    Symbol name;
+    bool defined;
+  };
+
+  std::vector<Global> globals;
+  std::unordered_map<Symbol, int> slots;
+
+public:
+  int slot(Symbol name) {
+    auto [found, inserted] =
+        slots.try_emplace(name, static_cast<int>(globals.size()));
+    if (inserted) {
+      globals.push_back(Global{nullptr, name, false});
+    }
+    return found->second;
+  }
+
+  const Value &get(int slot, const Token &name) {
+    Global &global = globals[slot];
+    if (!global.defined) {
+      undefined(name);
+    }
+    return global.value;
+  }
+
+  void assign(int slot, const Token &name, Value value) {
+    Global &global = globals[slot];
+    if (!global.defined) {
+      undefined(name);
+    }
+    global.value = std::move(value);
+  }
+
+  // Returns nullptr if the global has not been defined
+  Value *lookup(int slot) {
+    Global &global = globals[slot];
+    return global.defined ? &global.value : nullptr;
+  }
+
+  void define(int slot, Value value) {
+    Global &global = globals[slot];
+    global.value = std::move(value);
+    global.defined = true;
+  }
+
+  void define(Symbol name, Value value) {
+    define(slot(name), std::move(value));
+  }
+
+  // Undefines every global. Slots stay assigned, so slots callers cached
+  // stay valid.
+  void reset() {
+    for (Global &global : globals) {
+      global.value = nullptr;
+      global.defined = false;
+    }
+  }
+
+  // Number of slots handed out
+  [[nodiscard]] int count() const { return static_cast<int>(globals.size()); }
+
+  [[nodiscard]] const std::string &name(int slot) const {
+    return symbols.name(globals[slot].name);
+  }
+
+private:
+  [[noreturn]] static void undefined(const Token &name) {
+    throw RuntimeError(name, "Undefined variable '" + std::string{name.lexeme} +
+                                 "'.");
+  }
+};
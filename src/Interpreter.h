@@ -3,17 +3,20 @@
 #include "Environment.h"
 #include "Error.h"
 #include "Expr.h"
+#include "Globals.h"
+#include "LineProfiler.h"
 #include "LoxCallable.h"
 #include "LoxFunction.h"
-#include "LoxReturn.h"
-#include "NativeClock.h"
+#include "NativeFunction.h"
+#include "Natives.h"
+#include "Profiler.h"
+#include "Program.h"
 #include "RuntimeError.h"
 #include "Stmt.h"
-#include <any>
-#include <format> // std::format (c++20)
-#include <iostream>
-#include <map>
+#include "Value.h"
 #include <memory> // std::shared_ptr
+#include <ostream>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -21,136 +24,207 @@ class Interpreter : public ExprVisitor, public StmtVisitor {
   friend class LoxFunction;
 
 public:
-  std::shared_ptr<Environment> globals{new Environment};
+  Globals globals;
+  // Set to profile calls to Lox functions
+  Profiler *profiler = nullptr;
+  // Set to count every node run
+  LineProfiler *lineProfiler = nullptr;
 
 private:
-  std::shared_ptr<Environment> environment = globals;
-  std::map<std::shared_ptr<Expr>, int> locals;
+  // Innermost scope a closure captured; nullptr if there is none
+  std::shared_ptr<Environment> environment = nullptr;
+  // Locals of the scopes closures don't capture, one frame per call
+  std::vector<Value> stack;
+  // Where the running call's frame starts in `stack`
+  size_t frame = 0;
+  // Every program run so far that declares functions. LoxFunctions point into
+  // their syntax trees, so they must live as long as the Interpreter.
+  std::vector<Program> programs;
+  // Completion signal for `return`. visitReturnStmt sets it, every statement
+  // list and loop stops as soon as it is set, and the LoxFunction::call that
+  // started the body clears it and takes the value.
+  bool returning = false;
+  Value returnValue;
+  // Set along with `returning` by a return in tail position: rather than
+  // calling from inside the returning frame, visitReturnStmt leaves the callee
+  // and its arguments for LoxFunction::call to run in place of that frame.
+  Value tailCallee;
+  std::vector<Value> tailArguments;
+  // Where print statements write
+  std::ostream &out;
+  ErrorReporter &errors;
 
 public:
-  Interpreter() { globals->define("clock", std::make_shared<NativeClock>()); }
+  Interpreter(std::ostream &out, ErrorReporter &errors)
+      : out{out}, errors{errors} {
+    NativeRegistry::standard().defineAll(globals);
+  }
 
-  void interpret(const std::vector<std::shared_ptr<Stmt>> &statements) {
+  // Keeps the program alive for as long as the Interpreter if the functions
+  // it declares could outlive its run. Otherwise the caller keeps it for as
+  // long as it is run.
+  void load(const Program &program) {
+    if (program.declaresFunctions) {
+      programs.push_back(program);
+    }
+  }
+
+  void run(const Program &program) {
     try {
-      for (const std::shared_ptr<Stmt> &statement : statements) {
+      for (Stmt *statement : program.statements) {
         execute(statement);
       }
     } catch (RuntimeError error) {
-      runtimeError(error);
+      // Unwind to the top level
+      environment = nullptr;
+      stack.clear();
+      frame = 0;
+      errors.runtimeError(error);
     }
   }
 
-  void resolve(const std::shared_ptr<Expr> &expr, int depth) {
-    locals[expr] = depth;
-  }
-
 private:
-  std::any evaluate(const std::shared_ptr<Expr> &expr) {
+  Value evaluate(Expr *expr) {
+    if (lineProfiler != nullptr) {
+      lineProfiler->hit(expr);
+    }
     // send expression back into the visitor implementation
     return expr->accept(*this);
   }
 
-  void execute(const std::shared_ptr<Stmt> &stmt) { stmt->accept(*this); }
+  void execute(Stmt *stmt) {
+    if (lineProfiler != nullptr) {
+      lineProfiler->hit(stmt);
+    }
+    stmt->accept(*this);
+  }
 
-  void executeBlock(const std::vector<std::shared_ptr<Stmt>> &statements,
+  void executeBlock(std::span<Stmt *const> statements,
                     std::shared_ptr<Environment> env) {
-    std::shared_ptr<Environment> previous = this->environment;
-
-    try {
-      this->environment = std::move(env);
+    std::shared_ptr<Environment> previous = std::move(this->environment);
+    this->environment = std::move(env);
+    executeStatements(statements);
+    this->environment = std::move(previous);
+  }
 
-      for (const std::shared_ptr<Stmt> &statement : statements) {
-        execute(statement);
+  void executeStatements(std::span<Stmt *const> statements) {
+    for (Stmt *statement : statements) {
+      execute(statement);
+      if (returning) {
+        break;
       }
-    } catch (...) {
-      this->environment = previous;
-      throw;
     }
-
-    this->environment = previous;
   }
 
 public:
   // Statement visitor implementations
-  std::any visitVarStmt(std::shared_ptr<Var> stmt) override {
-    std::any value = nullptr;
+  void visitVarStmt(Var *stmt) override {
+    Value value = nullptr;
     if (stmt->initializer != nullptr) {
       value = evaluate(stmt->initializer);
     }
 
-    environment->define(stmt->name.lexeme, std::move(value));
-    return {};
+    define(stmt->name, stmt->binding, std::move(value));
   }
 
-  std::any visitIfStmt(std::shared_ptr<If> stmt) override {
+  void visitIfStmt(If *stmt) override {
     if (isTruthy(evaluate(stmt->condition))) {
       execute(stmt->thenBranch);
     } else if (stmt->elseBranch != nullptr) {
       execute(stmt->elseBranch);
     }
-
-    return {};
   }
 
-  std::any visitPrintStmt(std::shared_ptr<Print> stmt) override {
-    std::any value = evaluate(stmt->expression);
-    std::cout << stringify(value) << "\n";
-
-    return {};
+  void visitPrintStmt(Print *stmt) override {
+    Value value = evaluate(stmt->expression);
+    out << stringify(value) << "\n";
   }
 
-  std::any visitReturnStmt(std::shared_ptr<Return> stmt) override {
-    std::any value = nullptr;
+  void visitReturnStmt(Return *stmt) override {
+    if (stmt->tail) {
+      auto *call = static_cast<Call *>(stmt->value);
+      if (lineProfiler != nullptr) {
+        lineProfiler->hit(call);
+      }
+      // The arguments may make tail calls of their own, so tailCallee is only
+      // set once they are evaluated
+      Value callee = evaluate(call->callee);
+      size_t base = pushArguments(call);
+      std::span<Value> arguments = std::span{stack}.subspan(base);
+      LoxCallable *function =
+          callable(call->paren, callee, arguments.size());
+      if (callee.isObjType(ObjType::NATIVE)) {
+        // A native has no frame to run in place of this one's
+        returnValue = invoke(call->paren, function, arguments);
+      } else {
+        // The blocks being left pop the stack, so the arguments wait in
+        // tailArguments, whose storage is reused from call to call
+        tailCallee = std::move(callee);
+        tailArguments.clear();
+        for (Value &argument : arguments) {
+          tailArguments.push_back(std::move(argument));
+        }
+      }
+      stack.resize(base);
+      returning = true;
+      return;
+    }
+
+    Value value = nullptr;
     if (stmt->value != nullptr) {
       value = evaluate(stmt->value);
     }
 
-    throw LoxReturn{value};
+    returnValue = std::move(value);
+    returning = true;
   }
 
-  std::any visitWhileStmt(std::shared_ptr<While> stmt) override {
+  void visitWhileStmt(While *stmt) override {
     while (isTruthy(evaluate(stmt->condition))) {
       execute(stmt->body);
+      if (returning) {
+        break;
+      }
     }
-
-    return {};
   }
 
-  std::any visitBlockStmt(const std::shared_ptr<Block> stmt) override {
-    executeBlock(stmt->statements, std::make_shared<Environment>(environment));
-    return {};
+  void visitBlockStmt(Block *stmt) override {
+    if (stmt->captured) {
+      executeBlock(stmt->statements, Environment::make(environment));
+      return;
+    }
+
+    size_t top = stack.size();
+    executeStatements(stmt->statements);
+    stack.resize(top);
   }
 
-  std::any visitExpressionStmt(std::shared_ptr<Expression> stmt) override {
+  void visitExpressionStmt(Expression *stmt) override {
     evaluate(stmt->expression);
-
-    return {};
   }
 
-  std::any visitFunctionStmt(std::shared_ptr<Function> stmt) override {
-    std::shared_ptr<LoxFunction> function =
-        std::make_shared<LoxFunction>(stmt, environment);
-    environment->define(stmt->name.lexeme, function);
-
-    return {};
+  void visitFunctionStmt(Function *stmt) override {
+    define(stmt->name, stmt->binding,
+           Value{new LoxFunction{stmt, environment}});
   }
 
   // Expression visitor implementations
-  std::any visitAssignExpr(std::shared_ptr<Assign> expr) override {
-    std::any value = evaluate(expr->value);
+  Value visitAssignExpr(Assign *expr) override {
+    Value value = evaluate(expr->value);
 
-    if (locals.contains(expr)) {
-      int distance = locals[expr];
-      environment->assignAt(distance, expr->name, value);
+    if (expr->binding.onStack) {
+      stack[frame + expr->binding.slot] = value;
+    } else if (expr->binding.isLocal()) {
+      environment->assignAt(expr->binding.depth, expr->binding.slot, value);
     } else {
-      globals->assign(expr->name, value);
+      globals.assign(globalSlot(expr->name, expr->binding), expr->name, value);
     }
 
     return value;
   }
 
-  std::any visitLogicalExpr(std::shared_ptr<Logical> expr) override {
-    std::any left = evaluate(expr->left);
+  Value visitLogicalExpr(Logical *expr) override {
+    Value left = evaluate(expr->left);
 
     if (expr->op.type == OR) {
       if (isTruthy(left)) {
@@ -165,9 +239,9 @@ public:
     return evaluate(expr->right);
   }
 
-  std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
-    std::any left = evaluate(expr->left);
-    std::any right = evaluate(expr->right);
+  Value visitBinaryExpr(Binary *expr) override {
+    Value left = evaluate(expr->left);
+    Value right = evaluate(expr->right);
 
     switch (expr->op.type) {
     case BANG_EQUAL:
@@ -176,38 +250,35 @@ public:
       return isEqual(left, right);
     case GREATER:
       checkNumberOperands(expr->op, left, right);
-      return std::any_cast<double>(left) > std::any_cast<double>(right);
+      return left.asNumber() > right.asNumber();
     case GREATER_EQUAL:
       checkNumberOperands(expr->op, left, right);
-      return std::any_cast<double>(left) >= std::any_cast<double>(right);
+      return left.asNumber() >= right.asNumber();
     case LESS:
       checkNumberOperands(expr->op, left, right);
-      return std::any_cast<double>(left) < std::any_cast<double>(right);
+      return left.asNumber() < right.asNumber();
     case LESS_EQUAL:
       checkNumberOperands(expr->op, left, right);
-      return std::any_cast<double>(left) <= std::any_cast<double>(right);
+      return left.asNumber() <= right.asNumber();
     case MINUS:
       checkNumberOperands(expr->op, left, right);
-      return std::any_cast<double>(left) - std::any_cast<double>(right);
+      return left.asNumber() - right.asNumber();
     case PLUS:
-      if (left.type() == right.type()) {
-        if (left.type() == typeid(double)) {
-          return std::any_cast<double>(left) + std::any_cast<double>(right);
-        }
-        if (left.type() == typeid(std::string)) {
-          return std::any_cast<std::string>(left) +
-                 std::any_cast<std::string>(right);
-        }
+      if (left.isNumber() && right.isNumber()) {
+        return left.asNumber() + right.asNumber();
+      }
+      if (left.isString() && right.isString()) {
+        return concatenate(left, right);
       }
 
       throw RuntimeError(expr->op,
                          "Operands must be two numbers or two strings.");
     case SLASH:
       checkNumberOperands(expr->op, left, right);
-      return std::any_cast<double>(left) / std::any_cast<double>(right);
+      return left.asNumber() / right.asNumber();
     case STAR:
       checkNumberOperands(expr->op, left, right);
-      return std::any_cast<double>(left) * std::any_cast<double>(right);
+      return left.asNumber() * right.asNumber();
     default:
       break;
     }
@@ -216,13 +287,13 @@ public:
     return {};
   }
 
-  std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
-    std::any right = evaluate(expr->right);
+  Value visitUnaryExpr(Unary *expr) override {
+    Value right = evaluate(expr->right);
 
     switch (expr->op.type) {
     case MINUS:
       checkNumberOperand(expr->op, right);
-      return -std::any_cast<double>(right);
+      return -right.asNumber();
     case BANG:
       return !isTruthy(right);
 
@@ -232,130 +303,115 @@ public:
     }
   }
 
-  std::any visitCallExpr(std::shared_ptr<Call> expr) override {
-    std::any callee = evaluate(expr->callee);
-
-    std::vector<std::any> arguments{};
-    for (const std::shared_ptr<Expr> &argument : expr->arguments) {
-      arguments.push_back(evaluate(argument));
-    }
-
-    std::shared_ptr<LoxCallable> function;
-    if (callee.type() == typeid(std::shared_ptr<LoxFunction>)) {
-      function = std::any_cast<std::shared_ptr<LoxFunction>>(callee);
-    } else {
-      throw RuntimeError{expr->paren, "Can only call functions and classes."};
-    }
+  Value visitCallExpr(Call *expr) override {
+    Value callee = evaluate(expr->callee);
+    size_t base = pushArguments(expr);
+    std::span<Value> arguments = std::span{stack}.subspan(base);
 
-    if (arguments.size() != function->arity()) {
-      throw RuntimeError{expr->paren,
-                         "Expected " + std::to_string(function->arity()) +
-                             " arguments but got " +
-                             std::to_string(arguments.size()) + "."};
-    }
-    return function->call(*this, std::move(arguments));
+    LoxCallable *function =
+        callable(expr->paren, callee, arguments.size());
+    Value result = invoke(expr->paren, function, arguments);
+    stack.resize(base);
+    return result;
   }
 
-  std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
+  Value visitLiteralExpr(Literal *expr) override {
     return expr->value;
   }
 
-  std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) override {
+  Value visitGroupingExpr(Grouping *expr) override {
     return evaluate(expr->expression);
   }
 
-  std::any visitVariableExpr(std::shared_ptr<Variable> expr) override {
-    return lookUpVariable(expr->name, expr);
+  Value visitVariableExpr(Variable *expr) override {
+    return lookUpVariable(expr->name, expr->binding);
   }
 
 private:
   // helpers
-  std::any lookUpVariable(const Token &name,
-                          const std::shared_ptr<Expr> &expr) {
-    if (locals.contains(expr)) {
-      int distance = locals[expr];
-      return environment->getAt(distance, name.lexeme);
+  // Evaluates the call's arguments onto the value stack, where the callee's
+  // frame will start, and returns the index of the first
+  size_t pushArguments(Call *expr) {
+    size_t base = stack.size();
+    for (Expr *argument : expr->arguments) {
+      stack.push_back(evaluate(argument));
     }
 
-    return globals->get(name);
+    return base;
   }
 
-  void checkNumberOperand(const Token &op, const std::any &operand) {
-    if (operand.type() == typeid(double)) {
-      return;
+  // Checks that `callee` can be called with `count` arguments
+  static LoxCallable *callable(const Token &paren, const Value &callee,
+                               size_t count) {
+    if (!callee.isObjType(ObjType::FUNCTION) &&
+        !callee.isObjType(ObjType::NATIVE)) {
+      throw RuntimeError{paren, "Can only call functions and classes."};
     }
+    auto *function = callee.asObj<LoxCallable>();
 
-    throw RuntimeError(op, "Operand must be a number.");
-  }
-
-  void checkNumberOperands(const Token &op, const std::any &left,
-                           const std::any &right) {
-    if (left.type() == typeid(double) && right.type() == typeid(double)) {
-      return;
+    if (count != function->arity()) {
+      throw RuntimeError{paren, "Expected " +
+                                    std::to_string(function->arity()) +
+                                    " arguments but got " +
+                                    std::to_string(count) + "."};
     }
-
-    throw RuntimeError(op, "Operands must be a number.");
+    return function;
   }
 
-  bool isTruthy(const std::any &object) {
-    if (object.type() == typeid(nullptr)) {
-      return false;
-    }
-    if (object.type() == typeid(bool)) {
-      return std::any_cast<bool>(object);
+  // Calls a function that passed callable(), reporting a native function's
+  // errors at the call
+  Value invoke(const Token &paren, LoxCallable *function,
+               std::span<Value> arguments) {
+    try {
+      return function->call(*this, arguments);
+    } catch (const NativeError &error) {
+      throw RuntimeError{paren, error.what()};
     }
-
-    return true;
   }
 
-  bool isEqual(std::any &a, std::any &b) {
-    if (a.type() != b.type()) {
-      return false;
+  void define(const Token &name, Binding &binding, Value value) {
+    if (binding.onStack) {
+      // Locals are declared in slot order
+      stack.push_back(std::move(value));
+    } else if (binding.isLocal()) {
+      environment->define(std::move(value));
+    } else {
+      globals.define(globalSlot(name, binding), std::move(value));
     }
+  }
 
-    if (a.type() == typeid(nullptr)) {
-      return true;
+  Value lookUpVariable(const Token &name, Binding &binding) {
+    if (binding.onStack) {
+      return stack[frame + binding.slot];
     }
-    if (a.type() == typeid(bool)) {
-      return std::any_cast<bool>(a) == std::any_cast<bool>(b);
-    }
-    if (a.type() == typeid(double)) {
-      // returns false for (NaN == NaN), unlike jlox
-      return std::any_cast<double>(a) == std::any_cast<double>(b);
-    }
-    if (a.type() == typeid(std::string)) {
-      return std::any_cast<std::string>(a) == std::any_cast<std::string>(b);
+    if (binding.isLocal()) {
+      return environment->getAt(binding.depth, binding.slot);
     }
 
-    return false;
+    return globals.get(globalSlot(name, binding), name);
   }
 
-  std::string stringify(std::any &object) {
-    const auto &valueType = object.type();
-
-    // Type narrowing with any_cast + converting to string
-    if (valueType == typeid(nullptr)) {
-      return "nil";
-    }
-
-    if (valueType == typeid(double)) {
-      // uses std::format (C++20) to match jlox floating point error behaviour
-      std::string text = std::format("{}", std::any_cast<double>(object));
-      return text;
+  int globalSlot(const Token &name, Binding &binding) {
+    if (binding.global == -1) {
+      binding.global = globals.slot(name.symbol());
     }
+    return binding.global;
+  }
 
-    if (valueType == typeid(std::string)) {
-      return std::any_cast<std::string>(object);
+  void checkNumberOperand(const Token &op, const Value &operand) {
+    if (operand.isNumber()) {
+      return;
     }
 
-    if (valueType == typeid(bool)) {
-      return std::any_cast<bool>(object) ? "true" : "false";
-    }
+    throw RuntimeError(op, "Operand must be a number.");
+  }
 
-    if (valueType == typeid(std::shared_ptr<LoxFunction>)) {
-      return std::any_cast<std::shared_ptr<LoxFunction>>(object)->toString();
+  void checkNumberOperands(const Token &op, const Value &left,
+                           const Value &right) {
+    if (left.isNumber() && right.isNumber()) {
+      return;
     }
 
-    return "Error in Interpreter.stringify(): unsupported object type.";
+    throw RuntimeError(op, "Operands must be a number.");
   }
 };
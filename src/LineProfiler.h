@@ -0,0 +1,216 @@
+#pragma once
+
+#include "Arena.h"
+#include "Expr.h"
+#include "Program.h"
+#include "Source.h"
+#include "Stmt.h"
+#include "Value.h"
+#include <algorithm>
+#include <cstdint>
+#include <iomanip> // std::setw
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Counts how many times each node of the syntax tree runs and attributes the
+// counts to source lines, for an annotated listing in the style of gcov.
+//
+// Every program is added before it runs, which records the line each of its
+// nodes starts on. Engines then count a node each time they evaluate or
+// execute it. A line's count is that of its most frequently run node, so a
+// line is counted once per time it runs however many nodes it holds.
+class LineProfiler : public ExprVisitor, public StmtVisitor {
+  struct Node {
+    int line;
+    std::uint64_t count = 0;
+  };
+
+  struct Listing {
+    std::shared_ptr<const Source> source;
+    // Keeps the nodes, which key the counts, from being freed and their
+    // addresses reused
+    std::shared_ptr<Arena> arena;
+    std::vector<const Node *> nodes;
+  };
+
+  // Keyed by node. References into the map stay
+  // valid as it grows, so engines can hold on to a node's counter.
+  std::unordered_map<const void *, Node> nodes;
+  std::vector<Listing> listings;
+  // Line of the last node added, or 0 after an empty block
+  int lastLine = 0;
+
+public:
+  void add(const Program &program) {
+    listings.push_back(Listing{program.source, program.arena, {}});
+    for (Stmt *statement : program.statements) {
+      add(statement);
+    }
+  }
+
+  void hit(const void *node) { nodes[node].count++; }
+
+  std::uint64_t &counter(const void *node) { return nodes[node].count; }
+
+  // Prints each program's source with the number of times each line ran.
+  // Lines without code are marked "-" and lines that never ran "#####".
+  void report(std::ostream &out) const {
+    for (const Listing &listing : listings) {
+      std::vector<std::optional<std::uint64_t>> hits;
+      for (const Node *node : listing.nodes) {
+        auto line = static_cast<size_t>(node->line);
+        if (line >= hits.size()) {
+          hits.resize(line + 1);
+        }
+        hits[line] = std::max(hits[line].value_or(0), node->count);
+      }
+
+      std::string_view text = listing.source->view();
+      for (size_t line = 1; !text.empty(); line++) {
+        size_t end = std::min(text.find('\n'), text.size());
+        out << std::setw(9);
+        if (line >= hits.size() || !hits[line]) {
+          out << '-';
+        } else if (*hits[line] == 0) {
+          out << "#####";
+        } else {
+          out << *hits[line];
+        }
+        out << ':' << std::setw(5) << line << ':' << text.substr(0, end)
+            << '\n';
+        text.remove_prefix(std::min(end + 1, text.size()));
+      }
+    }
+  }
+
+  Value visitAssignExpr(Assign *expr) override {
+    add(expr->value);
+    record(expr, expr->name.line);
+    return {};
+  }
+
+  Value visitBinaryExpr(Binary *expr) override {
+    int line = add(expr->left);
+    add(expr->right);
+    record(expr, line);
+    return {};
+  }
+
+  Value visitCallExpr(Call *expr) override {
+    int line = add(expr->callee);
+    for (Expr *argument : expr->arguments) {
+      add(argument);
+    }
+    record(expr, line);
+    return {};
+  }
+
+  Value visitGroupingExpr(Grouping *expr) override {
+    record(expr, add(expr->expression));
+    return {};
+  }
+
+  Value visitLiteralExpr(Literal *expr) override {
+    record(expr, expr->line);
+    return {};
+  }
+
+  Value visitLogicalExpr(Logical *expr) override {
+    int line = add(expr->left);
+    add(expr->right);
+    record(expr, line);
+    return {};
+  }
+
+  Value visitUnaryExpr(Unary *expr) override {
+    add(expr->right);
+    record(expr, expr->op.line);
+    return {};
+  }
+
+  Value visitVariableExpr(Variable *expr) override {
+    record(expr, expr->name.line);
+    return {};
+  }
+
+  void visitBlockStmt(Block *stmt) override {
+    int line = 0;
+    for (Stmt *statement : stmt->statements) {
+      int start = add(statement);
+      if (line == 0) {
+        line = start;
+      }
+    }
+    // An empty block has no line to count
+    if (line != 0) {
+      record(stmt, line);
+    }
+    lastLine = line;
+  }
+
+  void visitExpressionStmt(Expression *stmt) override {
+    record(stmt, add(stmt->expression));
+  }
+
+  void visitFunctionStmt(Function *stmt) override {
+    for (Stmt *statement : stmt->body) {
+      add(statement);
+    }
+    record(stmt, stmt->name.line);
+  }
+
+  void visitIfStmt(If *stmt) override {
+    int line = add(stmt->condition);
+    add(stmt->thenBranch);
+    if (stmt->elseBranch != nullptr) {
+      add(stmt->elseBranch);
+    }
+    record(stmt, line);
+  }
+
+  void visitPrintStmt(Print *stmt) override {
+    record(stmt, add(stmt->expression));
+  }
+
+  void visitReturnStmt(Return *stmt) override {
+    if (stmt->value != nullptr) {
+      add(stmt->value);
+    }
+    record(stmt, stmt->keyword.line);
+  }
+
+  void visitVarStmt(Var *stmt) override {
+    if (stmt->initializer != nullptr) {
+      add(stmt->initializer);
+    }
+    record(stmt, stmt->name.line);
+  }
+
+  void visitWhileStmt(While *stmt) override {
+    int line = add(stmt->condition);
+    add(stmt->body);
+    record(stmt, line);
+  }
+
+private:
+  // Each returns the line the node starts on
+  int add(Expr *expr) {
+    expr->accept(*this);
+    return lastLine;
+  }
+
+  int add(Stmt *stmt) {
+    stmt->accept(*this);
+    return lastLine;
+  }
+
+  void record(const void *node, int line) {
+    Node &added = nodes.try_emplace(node, Node{line}).first->second;
+    listings.back().nodes.push_back(&added);
+    lastLine = line;
+  }
+};
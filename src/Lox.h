@@ -0,0 +1,372 @@
+#pragma once
+
+#include "BytecodeCache.h"
+#include "ClosureInterpreter.h"
+#include "Collector.h"
+#include "Compiler.h"
+#include "Error.h"
+#include "Globals.h"
+#include "Interpreter.h"
+#include "LineProfiler.h"
+#include "NativeFunction.h"
+#include "Natives.h"
+#include "Optimizer.h"
+#include "Parser.h"
+#include "Profiler.h"
+#include "Resolver.h"
+#include "Scanner.h"
+#include "Source.h"
+#include "SourceReader.h"
+#include "SymbolTable.h"
+#include "VM.h"
+#include "Value.h"
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility> // std::exchange, std::unreachable
+#include <vector>
+
+enum class Engine : std::uint8_t {
+  TREE,    // tree-walking Interpreter
+  VM,      // bytecode Compiler + VM
+  CLOSURE, // ClosureInterpreter
+};
+
+// A program scanned, parsed, resolved and compiled for the engine of the Lox
+// instance that compiled it. Only that instance can execute it, since global
+// slots are assigned by its engine.
+class CompiledScript {
+  friend class Lox;
+
+  const void *owner;
+  Program program;
+  // The ClosureInterpreter's compiled statements
+  std::vector<Exec> statements;
+  // The VM's top-level function
+  Value function;
+
+  CompiledScript(const void *owner, Program program)
+      : owner{owner}, program{std::move(program)} {}
+};
+
+// One Lox interpreter: an engine with its globals, the error state and the
+// streams it prints to. Everything a run touches belongs to an instance or to
+// the thread running it, so instances on different threads run independently.
+// An instance, and every value it creates, must stay on one thread.
+//
+// For embedding, compile() does everything up to execution once, and
+// execute() runs the result as many times as needed. Between runs, the host
+// can reset the globals and bind its own.
+class Lox {
+public:
+  struct Options {
+    Engine engine = Engine::TREE;
+    bool optimize = true;
+    std::optional<Profiler::Format> profileFormat = std::nullopt;
+    bool lineProfile = false;
+    double gcGrowth = 2.0;
+    bool gcStats = false;
+  };
+
+private:
+  Options options;
+  std::ostream &err;
+  ErrorReporter errors;
+  Profiler profiler;
+  LineProfiler lineProfiler;
+  Collector::Statistics gcStatistics;
+  // Defined again by resetGlobals()
+  NativeRegistry natives = NativeRegistry::standard();
+  // Only the engine in use is created
+  std::optional<Interpreter> interpreter;
+  std::optional<VM> vm;
+  std::optional<ClosureInterpreter> closureInterpreter;
+
+public:
+  Lox(Options options, std::ostream &out, std::ostream &err)
+      : options{options}, err{err}, errors{err} {
+    switch (options.engine) {
+    case Engine::TREE:
+      interpreter.emplace(out, errors);
+      interpreter->profiler = options.profileFormat ? &profiler : nullptr;
+      break;
+    case Engine::VM:
+      vm.emplace(out, errors);
+      break;
+    case Engine::CLOSURE:
+      closureInterpreter.emplace(out, errors);
+      closureInterpreter->profiler =
+          options.profileFormat ? &profiler : nullptr;
+      break;
+    }
+    profileLines(options.lineProfile);
+  }
+
+  Lox(const Lox &) = delete;
+  Lox &operator=(const Lox &) = delete;
+
+  // Frees the reference cycles the instance's values were part of
+  ~Lox() {
+    interpreter.reset();
+    vm.reset();
+    closureInterpreter.reset();
+    Collector::local().collect();
+  }
+
+  // Compiles and executes a source
+  void run(std::shared_ptr<const Source> source,
+           const std::string &cachePath = "") {
+    std::optional<CompiledScript> script =
+        compile(std::move(source), cachePath);
+    if (script) {
+      execute(*script);
+    }
+  }
+
+  // Runs a script as it is read, one top-level declaration at a time. Each
+  // declaration is scanned, parsed, compiled and executed before the next is
+  // read, and is freed once it has run unless it declares functions, so a
+  // script of any size runs in the memory of its largest declaration and the
+  // values it keeps.
+  //
+  // Unlike run(), the declarations before one with an error have already run
+  // when it is reported. After a syntax error nothing more runs, but the rest
+  // of the stream is still parsed so that later syntax errors are reported
+  // too; any other error stops the stream. Lines aren't profiled, since their
+  // counts would grow with the stream, and no cache is used.
+  void stream(SourceReader &reader) {
+    profileLines(false);
+    bool hadError = std::exchange(errors.hadError, false);
+    Scanner scanner{reader, errors};
+    Parser parser{scanner, errors};
+    for (;;) {
+      Program program = parser.next();
+      if (program.statements.empty()) {
+        break;
+      }
+      if (errors.hadError) {
+        continue;
+      }
+
+      std::optional<CompiledScript> script =
+          prepare(std::move(program), false);
+      if (!script || !execute(*script)) {
+        break;
+      }
+    }
+    errors.hadError = errors.hadError || hadError;
+    profileLines(options.lineProfile);
+  }
+
+  // Returns nothing if the source has a syntax, resolution or compile error,
+  // which is reported.
+  //
+  // Given a cache path, the VM engine loads the script's bytecode from that
+  // file if it is up to date, and otherwise compiles the script and writes
+  // the file (see BytecodeCache.h). The other engines ignore it.
+  std::optional<CompiledScript>
+  compile(std::shared_ptr<const Source> source,
+          const std::string &cachePath = "") {
+    bool hadError = std::exchange(errors.hadError, false);
+    std::optional<CompiledScript> script =
+        build(std::move(source), cachePath);
+    errors.hadError = errors.hadError || hadError;
+    return script;
+  }
+
+  // Returns false if the script stopped with a runtime error, which is
+  // reported. A script compiled by another instance is refused the same way,
+  // since its global slots index that instance's globals.
+  bool execute(const CompiledScript &script) {
+    if (script.owner != this) {
+      err << "Script compiled by another Lox instance.\n";
+      errors.hadRuntimeError = true;
+      return false;
+    }
+
+    Collector &collector = Collector::local();
+    collector.growth = options.gcGrowth;
+    Collector::Statistics *previous =
+        std::exchange(collector.statistics, &gcStatistics);
+    bool hadRuntimeError = std::exchange(errors.hadRuntimeError, false);
+
+    switch (options.engine) {
+    case Engine::TREE:
+      interpreter->run(script.program);
+      break;
+    case Engine::VM:
+      vm->interpret(script.function);
+      break;
+    case Engine::CLOSURE:
+      closureInterpreter->run(script.statements);
+      break;
+    }
+
+    bool succeeded = !errors.hadRuntimeError;
+    errors.hadRuntimeError = errors.hadRuntimeError || hadRuntimeError;
+    collector.statistics = previous;
+    return succeeded;
+  }
+
+  // Undefines every global but the native functions, including the host's
+  void resetGlobals() {
+    globals().reset();
+    natives.defineAll(globals());
+  }
+
+  // Binds a global for the scripts to use
+  void define(std::string_view name, Value value) {
+    globals().define(symbols.intern(name), std::move(value));
+  }
+
+  // Binds a C++ function as a native for the scripts to call, for instance
+  //
+  //   double square(double x) { return x * x; }
+  //   lox.defineNative<square>("square");
+  //
+  // See NativeFunction::declare for the types it may take and return.
+  template <auto function> void defineNative(std::string name) {
+    NativeFunction::Declaration declaration =
+        NativeFunction::declare<function>(std::move(name));
+    NativeRegistry::define(globals(), declaration);
+    natives.add(std::move(declaration));
+  }
+
+  // Returns nullptr if the global isn't defined
+  const Value *global(std::string_view name) {
+    return globals().lookup(globals().slot(symbols.intern(name)));
+  }
+
+  // Prints the profiles and collector statistics, if any were requested
+  void report() {
+    if (options.profileFormat) {
+      profiler.report(err, *options.profileFormat);
+    }
+    if (options.lineProfile) {
+      lineProfiler.report(err);
+    }
+    if (options.gcStats) {
+      gcStatistics.report(err);
+    }
+  }
+
+  // Exit status for the runs so far, as in sysexits.h
+  [[nodiscard]] int status() const {
+    if (errors.hadError) {
+      return 65;
+    }
+    if (errors.hadRuntimeError) {
+      return 70;
+    }
+    return 0;
+  }
+
+  // Lets the REPL carry on after a line with a syntax error
+  void clearError() { errors.hadError = false; }
+
+private:
+  // Does the work of compile() with no errors reported yet
+  std::optional<CompiledScript> build(std::shared_ptr<const Source> source,
+                                      const std::string &cachePath) {
+    assert(source != nullptr && "no source (Source::map failed?)");
+    bool cached = !cachePath.empty() && options.engine == Engine::VM;
+    if (cached) {
+      Value function = BytecodeCache::load(cachePath, source->view(),
+                                           options.optimize, vm->globals);
+      if (!function.isNil()) {
+        CompiledScript script{this,
+                              Program{std::move(source), nullptr, {}, false}};
+        script.function = std::move(function);
+        return script;
+      }
+    }
+
+    Scanner scanner{source->view(), errors};
+    Parser parser{scanner.scanTokens(), errors};
+    Program program = parser.parse();
+    program.source = std::move(source);
+
+    // Stop if there was a syntax error
+    if (errors.hadError) {
+      return std::nullopt;
+    }
+
+    std::optional<CompiledScript> script =
+        prepare(std::move(program), options.lineProfile);
+    if (script && cached) {
+      BytecodeCache::save(cachePath, script->program.source->view(),
+                          options.optimize, script->function, vm->globals);
+    }
+    return script;
+  }
+
+  // Resolves, optimizes and compiles a parsed program for the engine
+  std::optional<CompiledScript> prepare(Program program, bool profileLines) {
+    Resolver resolver{errors};
+    resolver.resolve(program.statements);
+
+    // Stop if there was a resolution error
+    if (errors.hadError) {
+      return std::nullopt;
+    }
+
+    if (options.optimize) {
+      Optimizer optimizer{*program.arena};
+      program.statements = optimizer.optimize(program.statements);
+    }
+
+    // The VM doesn't count nodes
+    if (profileLines && options.engine != Engine::VM) {
+      lineProfiler.add(program);
+    }
+
+    CompiledScript script{this, std::move(program)};
+    switch (options.engine) {
+    case Engine::TREE:
+      interpreter->load(script.program);
+      break;
+    case Engine::VM: {
+      Compiler compiler{vm->globals, errors};
+      script.function = compiler.compile(script.program.statements);
+
+      // Stop if there was a compile error
+      if (errors.hadError) {
+        return std::nullopt;
+      }
+      break;
+    }
+    case Engine::CLOSURE:
+      script.statements = closureInterpreter->load(script.program);
+      break;
+    }
+
+    return script;
+  }
+
+  // Points the engine at the line profiler, or detaches it. The VM has none.
+  void profileLines(bool enabled) {
+    LineProfiler *counts = enabled ? &lineProfiler : nullptr;
+    if (interpreter) {
+      interpreter->lineProfiler = counts;
+    }
+    if (closureInterpreter) {
+      closureInterpreter->lineProfiler = counts;
+    }
+  }
+
+  Globals &globals() {
+    switch (options.engine) {
+    case Engine::TREE:
+      return interpreter->globals;
+    case Engine::VM:
+      return vm->globals;
+    case Engine::CLOSURE:
+      return closureInterpreter->globals;
+    }
+    std::unreachable();
+  }
+};
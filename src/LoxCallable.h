@@ -1,16 +1,20 @@
 #pragma once
 
-#include <any>
+#include "Obj.h"
+#include "Value.h"
+#include <span>
 #include <string>
-#include <vector>
 
 class Interpreter;
 
-class LoxCallable {
+class LoxCallable : public Obj {
 public:
+  LoxCallable(ObjType type) : Obj{type} {}
+
   virtual size_t arity() = 0;
-  virtual std::any call(Interpreter &interpreter,
-                        std::vector<std::any> arguments) = 0;
-  virtual std::string toString() = 0;
-  virtual ~LoxCallable() = default;
+  // `arguments` are the values on top of the interpreter's value stack, which
+  // the caller pops after the call. A Lox function takes them over as the
+  // first slots of its frame, so a call copies and allocates nothing for
+  // them. They are only valid until the callee runs Lox code.
+  virtual Value call(Interpreter &interpreter, std::span<Value> arguments) = 0;
 };
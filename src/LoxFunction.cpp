@@ -1,32 +1,81 @@
 #include "LoxFunction.h"
 #include "Environment.h"
 #include "Interpreter.h"
+#include "Profiler.h"
 #include "Stmt.h"
+#include <optional>
 
-LoxFunction::LoxFunction(std::shared_ptr<Function> declaration,
+LoxFunction::LoxFunction(Function *declaration,
                          std::shared_ptr<Environment> closure)
-    : declaration(std::move(declaration)), closure(std::move(closure)) {}
+    : LoxCallable{ObjType::FUNCTION}, declaration(declaration),
+      closure(std::move(closure)) {}
 
 size_t LoxFunction::arity() { return declaration->params.size(); }
 
-std::any LoxFunction::call(Interpreter &interpreter,
-                           std::vector<std::any> arguments) {
-  std::shared_ptr<Environment> environment =
-      std::make_shared<Environment>(closure);
+Value LoxFunction::call(Interpreter &interpreter,
+                        std::span<Value> arguments) {
+  // A call in tail position replaces the function being run, so tail
+  // recursion runs in one C++ frame and one call frame at a time.
+  // `tailFunction` keeps the replacement alive.
+  LoxFunction *function = this;
+  Value tailFunction;
+  Value result;
 
-  for (size_t i = 0; i < declaration->params.size(); i++) {
-    environment->define(declaration->params[i].lexeme, arguments[i]);
-  }
+  // The arguments are already where the frame starts
+  size_t previousFrame = interpreter.frame;
+  interpreter.frame = interpreter.stack.size() - arguments.size();
+
+  for (;;) {
+    std::optional<Profiler::Call> profile;
+    if (interpreter.profiler != nullptr) {
+      profile.emplace(*interpreter.profiler, function->declaration,
+                      function->declaration->name.lexeme,
+                      function->declaration->name.line);
+    }
+
+    // Parameters share the body's scope, which only gets an Environment if a
+    // closure captures it
+    if (function->declaration->captured) {
+      std::shared_ptr<Environment> environment =
+          Environment::make(function->closure);
+      for (size_t i = interpreter.frame; i < interpreter.stack.size(); i++) {
+        environment->define(std::move(interpreter.stack[i]));
+      }
+      interpreter.stack.resize(interpreter.frame);
+      interpreter.executeBlock(function->declaration->body,
+                               std::move(environment));
+    } else {
+      interpreter.executeBlock(function->declaration->body, function->closure);
+    }
+    interpreter.stack.resize(interpreter.frame);
+
+    if (!interpreter.returning) {
+      break;
+    }
+    interpreter.returning = false;
 
-  try {
-    interpreter.executeBlock(declaration->body, environment);
-  } catch (LoxReturn returnValue) {
-    return returnValue.value;
+    if (interpreter.tailCallee.isNil()) {
+      result = std::move(interpreter.returnValue);
+      break;
+    }
+    // visitReturnStmt calls natives itself, so this is a LoxFunction
+    tailFunction = std::move(interpreter.tailCallee);
+    function = tailFunction.asObj<LoxFunction>();
+    for (Value &argument : interpreter.tailArguments) {
+      interpreter.stack.push_back(std::move(argument));
+    }
   }
 
-  return nullptr;
+  interpreter.frame = previousFrame;
+  return result;
+}
+
+void LoxFunction::trace(const Visit &visit) const {
+  if (closure != nullptr) {
+    visit(closure.get());
+  }
 }
 
 std::string LoxFunction::toString() {
-  return "<fn " + declaration->name.lexeme + ">";
+  return "<fn " + std::string{declaration->name.lexeme} + ">";
 }
@@ -1,22 +1,32 @@
 #pragma once
 
+#include "Collector.h"
 #include "LoxCallable.h"
-#include <any>
+#include "Value.h"
+#include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
-#include <vector>
 
 class Environment;
 struct Function;
 
-class LoxFunction : public LoxCallable {
-  std::shared_ptr<Function> declaration;
+class LoxFunction : public LoxCallable, public Traced {
+  // Owned by the arena of the program that declared it
+  Function *declaration;
   std::shared_ptr<Environment> closure;
 
 public:
-  LoxFunction(std::shared_ptr<Function> declaration,
+  LoxFunction(Function *declaration,
               std::shared_ptr<Environment> closure);
   size_t arity() override;
-  std::any call(Interpreter &interpreter,
-                std::vector<std::any> arguments) override;
+  Value call(Interpreter &interpreter, std::span<Value> arguments) override;
   std::string toString() override;
+
+  [[nodiscard]] std::int64_t references() const override { return owners(); }
+  void trace(const Visit &visit) const override;
+  void clear() override { closure = nullptr; }
+  std::shared_ptr<void> keepAlive() override {
+    return Traced::keepAlive(this);
+  }
 };
@@ -1,7 +0,0 @@
-#pragma once
-
-#include <any>
-
-struct LoxReturn {
-  const std::any value;
-};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Obj.h"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Strings are interned: there is at most one live LoxString per distinct
+// contents, so equal strings can be compared by pointer.
+class LoxString : public Obj {
+  using Table = std::unordered_map<std::string_view, LoxString *>;
+
+  LoxString(std::string chars)
+      : Obj{ObjType::STRING}, chars{std::move(chars)} {}
+
+  // Does not own its entries; a string removes itself when it is freed.
+  // One per thread, since a string belongs to the thread that created it.
+  // Never destroyed, so strings released during static destruction can still
+  // unregister.
+  static Table &table() {
+    thread_local auto *strings = new Table{};
+    return *strings;
+  }
+
+public:
+  const std::string chars;
+
+  // Returns the existing string with these contents, or a new one with no
+  // owners yet
+  static LoxString *intern(std::string chars) {
+    auto found = table().find(chars);
+    if (found != table().end()) {
+      return found->second;
+    }
+
+    auto *string = new LoxString{std::move(chars)};
+    table().emplace(string->chars, string);
+    return string;
+  }
+
+  ~LoxString() override { table().erase(chars); }
+
+  std::string toString() override { return chars; }
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Obj.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// A string produced by concatenation: a prefix of a growable buffer that is
+// shared with the strings it was built from. Unlike LoxString these are not
+// interned, so building one never hashes its contents.
+class LoxStringSlice : public Obj {
+  std::shared_ptr<std::string> buffer;
+  size_t length;
+
+  LoxStringSlice(std::shared_ptr<std::string> buffer)
+      : Obj{ObjType::STRING_SLICE}, buffer{std::move(buffer)},
+        length{this->buffer->size()} {}
+
+public:
+  // Returns a new string with no owners yet
+  static LoxStringSlice *concatenate(std::string_view a, std::string_view b) {
+    auto buffer = std::make_shared<std::string>();
+    buffer->reserve(a.size() + b.size());
+    buffer->append(a).append(b);
+    return new LoxStringSlice{std::move(buffer)};
+  }
+
+  // Returns this string followed by `suffix`. If this is the newest string on
+  // its buffer the suffix is appended in place, so a string built up in a
+  // loop is copied only when the buffer grows. Older strings only ever look at
+  // their own prefix, so they are unaffected.
+  LoxStringSlice *append(std::string_view suffix) {
+    // Appending may move the buffer, which `suffix` could be a part of
+    if (length == buffer->size() && !overlaps(suffix)) {
+      buffer->append(suffix);
+      return new LoxStringSlice{buffer};
+    }
+
+    return concatenate(chars(), suffix);
+  }
+
+  [[nodiscard]] std::string_view chars() const {
+    return {buffer->data(), length};
+  }
+
+  std::string toString() override { return std::string{chars()}; }
+
+private:
+  [[nodiscard]] bool overlaps(std::string_view other) const {
+    const char *begin = buffer->data();
+    const char *end = begin + buffer->size();
+    return std::less_equal<>{}(begin, other.data()) &&
+           std::less<>{}(other.data(), end);
+  }
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "LoxCallable.h"
+#include "LoxString.h"
+#include "Value.h"
+#include <array>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// Thrown by a native function, or by the checks before it runs, to stop the
+// script with a runtime error at the call
+class NativeError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// A function written in C++ and callable from Lox. It declares its parameter
+// types, and every engine checks the arguments against them before calling,
+// so the function itself gets them unboxed. The arguments are a span over
+// wherever the engine already keeps them (the VM passes its stack), so a call
+// copies nothing.
+class NativeFunction : public LoxCallable {
+public:
+  enum class Type : std::uint8_t { ANY, NUMBER, STRING, BOOL };
+
+  // Runs the function on arguments that passed the checks
+  using Function = Value (*)(std::span<const Value> arguments);
+
+  // What a registry (see Natives.h) keeps of a native function. Each engine
+  // makes NativeFunction objects of its own from it, since runtime objects
+  // belong to one thread.
+  struct Declaration {
+    std::string name;
+    std::span<const Type> parameters;
+    Function function;
+  };
+
+  // Declares `function`, a pointer to a C++ function, with the parameter and
+  // return types taken from its signature. Parameters may be double, bool,
+  // std::string_view or Value (for any type); the result may be any of those,
+  // std::string or void (for nil).
+  template <auto function> static Declaration declare(std::string name) {
+    using Signature = Unboxed<decltype(function)>;
+    return Declaration{std::move(name), Signature::types,
+                       &Signature::template call<function>};
+  }
+
+private:
+  const Declaration declaration;
+
+public:
+  NativeFunction(Declaration declaration)
+      : LoxCallable{ObjType::NATIVE}, declaration{std::move(declaration)} {}
+
+  // Throws a NativeError if the arguments don't match the parameters or the
+  // function fails
+  Value invoke(std::span<const Value> arguments) const {
+    std::span<const Type> parameters = declaration.parameters;
+    if (arguments.size() != parameters.size()) {
+      throw NativeError{"Expected " + std::to_string(parameters.size()) +
+                        " arguments but got " +
+                        std::to_string(arguments.size()) + "."};
+    }
+    for (size_t i = 0; i < parameters.size(); i++) {
+      if (!matches(arguments[i], parameters[i])) {
+        throw NativeError{"Argument " + std::to_string(i + 1) + " to " +
+                          declaration.name + " must be " +
+                          describe(parameters[i]) + "."};
+      }
+    }
+    return declaration.function(arguments);
+  }
+
+  size_t arity() override { return declaration.parameters.size(); }
+
+  Value call([[maybe_unused]] Interpreter &interpreter,
+             std::span<Value> arguments) override {
+    return invoke(arguments);
+  }
+
+  std::string toString() override { return "<native fn>"; }
+
+private:
+  static bool matches(const Value &value, Type type) {
+    switch (type) {
+    case Type::ANY:
+      return true;
+    case Type::NUMBER:
+      return value.isNumber();
+    case Type::STRING:
+      return value.isString();
+    case Type::BOOL:
+      return value.isBool();
+    }
+    return false;
+  }
+
+  static std::string describe(Type type) {
+    switch (type) {
+    case Type::NUMBER:
+      return "a number";
+    case Type::STRING:
+      return "a string";
+    case Type::BOOL:
+      return "a boolean";
+    default:
+      return "a value";
+    }
+  }
+
+  template <class T> static constexpr Type typeOf() {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<U, double>) {
+      return Type::NUMBER;
+    } else if constexpr (std::is_same_v<U, std::string_view>) {
+      return Type::STRING;
+    } else if constexpr (std::is_same_v<U, bool>) {
+      return Type::BOOL;
+    } else {
+      static_assert(std::is_same_v<U, Value>, "unsupported parameter type");
+      return Type::ANY;
+    }
+  }
+
+  template <class T> static decltype(auto) unbox(const Value &value) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<U, double>) {
+      return value.asNumber();
+    } else if constexpr (std::is_same_v<U, std::string_view>) {
+      return value.asString();
+    } else if constexpr (std::is_same_v<U, bool>) {
+      return value.asBool();
+    } else {
+      return (value);
+    }
+  }
+
+  template <class T> static Value box(T &&result) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<U, std::string>) {
+      return Value{LoxString::intern(std::forward<T>(result))};
+    } else if constexpr (std::is_same_v<U, std::string_view>) {
+      return Value{LoxString::intern(std::string{result})};
+    } else {
+      return Value{std::forward<T>(result)};
+    }
+  }
+
+  template <class Signature> struct Unboxed;
+
+  template <class Result, class... Parameters>
+  struct Unboxed<Result (*)(Parameters...)> {
+    static constexpr std::array<Type, sizeof...(Parameters)> types{
+        typeOf<Parameters>()...};
+
+    template <auto function>
+    static Value call([[maybe_unused]] std::span<const Value> arguments) {
+      return [&]<size_t... I>(std::index_sequence<I...>) {
+        if constexpr (std::is_void_v<Result>) {
+          function(unbox<Parameters>(arguments[I])...);
+          return Value{};
+        } else {
+          return box(function(unbox<Parameters>(arguments[I])...));
+        }
+      }(std::index_sequence_for<Parameters...>{});
+    }
+  };
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Globals.h"
+#include "NativeFunction.h"
+#include "SymbolTable.h"
+#include "Value.h"
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A set of native functions to define as globals. Engines start out with the
+// standard() natives; a host embedding Lox can add its own (see Lox.h).
+class NativeRegistry {
+  std::vector<NativeFunction::Declaration> declarations;
+
+public:
+  // Adds `function` (see NativeFunction::declare) as the global `name`,
+  // replacing any native of that name
+  template <auto function> void add(std::string name) {
+    add(NativeFunction::declare<function>(std::move(name)));
+  }
+
+  void add(NativeFunction::Declaration declaration) {
+    for (NativeFunction::Declaration &existing : declarations) {
+      if (existing.name == declaration.name) {
+        existing = std::move(declaration);
+        return;
+      }
+    }
+    declarations.push_back(std::move(declaration));
+  }
+
+  void defineAll(Globals &globals) const {
+    for (const NativeFunction::Declaration &declaration : declarations) {
+      define(globals, declaration);
+    }
+  }
+
+  static void define(Globals &globals,
+                     const NativeFunction::Declaration &declaration) {
+    globals.define(symbols.intern(declaration.name),
+                   Value{new NativeFunction{declaration}});
+  }
+
+  // The natives every engine starts out with
+  static const NativeRegistry &standard() {
+    static const NativeRegistry registry = [] {
+      NativeRegistry natives;
+      natives.add<clock>("clock");
+      natives.add<absolute>("abs");
+      natives.add<floor>("floor");
+      natives.add<squareRoot>("sqrt");
+      natives.add<length>("len");
+      natives.add<substring>("substring");
+      return natives;
+    }();
+    return registry;
+  }
+
+  // The standard natives, public since NativeFunction calls them
+
+  // Thousands of seconds since the epoch
+  static double clock() {
+    auto ticks = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration<double>{ticks}.count() / 1000.0;
+  }
+
+  // The standard library's functions can't portably be taken the address of
+  static double absolute(double x) { return std::fabs(x); }
+  static double floor(double x) { return std::floor(x); }
+  static double squareRoot(double x) { return std::sqrt(x); }
+
+  static double length(std::string_view string) {
+    return static_cast<double>(string.size());
+  }
+
+  // The characters of `string` from index `start` up to, but not including,
+  // index `end`
+  static std::string_view substring(std::string_view string, double start,
+                                    double end) {
+    auto size = static_cast<double>(string.size());
+    if (start != std::floor(start) || end != std::floor(end) || start < 0 ||
+        end < start || end > size) {
+      throw NativeError{"Substring bounds out of range."};
+    }
+    return string.substr(static_cast<size_t>(start),
+                         static_cast<size_t>(end - start));
+  }
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class ObjType : std::uint8_t {
+  STRING,
+  STRING_SLICE,
+  FUNCTION,
+  NATIVE,
+  COMPILED_FUNCTION,
+  CLOSURE,
+  UPVALUE,
+  CLOSURE_FUNCTION,
+};
+
+// Base class of every heap-allocated Lox runtime object (strings, functions).
+// Objects are intrusively reference counted by the Values that hold them, so
+// a Value stays 16 bytes and copying one never allocates.
+class Obj {
+  friend class Value;
+  std::uint32_t refCount = 0;
+
+public:
+  const ObjType type;
+
+  Obj(ObjType type) : type{type} {}
+  Obj(const Obj &) = delete;
+  Obj &operator=(const Obj &) = delete;
+
+  // Number of Values holding this object
+  [[nodiscard]] std::uint32_t owners() const { return refCount; }
+
+  virtual std::string toString() = 0;
+  virtual ~Obj() = default;
+};
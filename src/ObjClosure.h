@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Collector.h"
+#include "Obj.h"
+#include "ObjFunction.h"
+#include "Value.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A variable captured by a closure. While the variable is still on the VM
+// stack the upvalue is "open" and points at its stack slot; when the variable
+// goes out of scope it is "closed" by moving the value into `closed`.
+//
+// A closure stored in a variable it captured refers to itself through the
+// closed upvalue, so the Collector traces both.
+class ObjUpvalue : public Obj, public Traced {
+public:
+  Value *location;
+  Value closed;
+
+  ObjUpvalue(Value *slot) : Obj{ObjType::UPVALUE}, location{slot} {}
+
+  std::string toString() override { return "upvalue"; }
+
+  [[nodiscard]] std::int64_t references() const override { return owners(); }
+
+  // An open upvalue's variable lives on the VM stack, which is a root
+  void trace(const Visit &visit) const override {
+    Traced::trace(closed, visit);
+  }
+
+  void clear() override { closed = nullptr; }
+
+  std::shared_ptr<void> keepAlive() override {
+    return Traced::keepAlive(this);
+  }
+};
+
+class ObjClosure : public Obj, public Traced {
+public:
+  const Value function;
+  std::vector<Value> upvalues;
+
+  ObjClosure(Value function)
+      : Obj{ObjType::CLOSURE}, function{std::move(function)} {
+    upvalues.resize(getFunction()->upvalueCount);
+  }
+
+  [[nodiscard]] ObjFunction *getFunction() const {
+    return function.asObj<ObjFunction>();
+  }
+
+  [[nodiscard]] ObjUpvalue *getUpvalue(int index) const {
+    return upvalues[index].asObj<ObjUpvalue>();
+  }
+
+  std::string toString() override { return getFunction()->toString(); }
+
+  [[nodiscard]] std::int64_t references() const override { return owners(); }
+
+  // The function is constant data, shared by every closure made from it
+  void trace(const Visit &visit) const override {
+    for (const Value &upvalue : upvalues) {
+      Traced::trace(upvalue, visit);
+    }
+  }
+
+  void clear() override {
+    for (Value &upvalue : upvalues) {
+      upvalue = nullptr;
+    }
+  }
+
+  std::shared_ptr<void> keepAlive() override {
+    return Traced::keepAlive(this);
+  }
+};
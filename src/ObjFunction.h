@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Chunk.h"
+#include "Obj.h"
+#include <string>
+
+// A function compiled to bytecode by the Compiler. The VM never calls these
+// directly; it wraps them in an ObjClosure together with their upvalues.
+class ObjFunction : public Obj {
+public:
+  int arity = 0;
+  int upvalueCount = 0;
+  Chunk chunk;
+  std::string name;
+
+  ObjFunction(std::string name)
+      : Obj{ObjType::COMPILED_FUNCTION}, name{std::move(name)} {}
+
+  std::string toString() override {
+    if (name.empty()) {
+      return "<script>";
+    }
+    return "<fn " + name + ">";
+  }
+};
@@ -0,0 +1,431 @@
+#pragma once
+
+#include "Arena.h"
+#include "Expr.h"
+#include "LoxString.h"
+#include "Stmt.h"
+#include "Value.h"
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Rewrites a resolved syntax tree into a cheaper equivalent. Constant
+// expressions are folded, branches and loops that can never run are dropped,
+// and arithmetic identities are simplified. Anything that could raise a
+// runtime error is left alone, so errors are still reported when and where
+// they would have been.
+//
+// Rewritten nodes are allocated in the program's arena; unchanged subtrees are
+// shared with the original tree.
+class Optimizer : public ExprVisitor, public StmtVisitor {
+  Arena &arena;
+  // Results of the last visit. A null statement means it has no effect and
+  // can be removed.
+  Expr *optimizedExpr = nullptr;
+  Stmt *optimizedStmt = nullptr;
+
+public:
+  Optimizer(Arena &arena) : arena{arena} {}
+
+  std::vector<Stmt *> optimize(std::span<Stmt *const> statements) {
+    std::vector<Stmt *> result;
+    for (Stmt *statement : statements) {
+      if (Stmt *optimized = optimize(statement)) {
+        result.push_back(optimized);
+      }
+    }
+
+    return result;
+  }
+
+  Value visitAssignExpr(Assign *expr) override {
+    Expr *value = optimize(expr->value);
+    if (value == expr->value) {
+      optimizedExpr = expr;
+    } else {
+      auto *assign = arena.make<Assign>(expr->name, value);
+      assign->binding = expr->binding;
+      optimizedExpr = assign;
+    }
+    return {};
+  }
+
+  Value visitBinaryExpr(Binary *expr) override {
+    Expr *left = optimize(expr->left);
+    Expr *right = optimize(expr->right);
+
+    auto *leftLiteral = dynamic_cast<Literal *>(left);
+    auto *rightLiteral = dynamic_cast<Literal *>(right);
+    if (leftLiteral != nullptr && rightLiteral != nullptr) {
+      std::optional<Value> value =
+          fold(expr->op.type, leftLiteral->value, rightLiteral->value);
+      if (value) {
+        optimizedExpr = arena.make<Literal>(*value, expr->op.line);
+        return {};
+      }
+    }
+
+    // x * 1, 1 * x, x / 1 and x - 0 are exactly x for any number x (but
+    // x + 0 is not: -0 + 0 is 0)
+    switch (expr->op.type) {
+    case STAR:
+      if (isNumber(left) && isLiteral(right, 1.0)) {
+        optimizedExpr = left;
+        return {};
+      }
+      if (isLiteral(left, 1.0) && isNumber(right)) {
+        optimizedExpr = right;
+        return {};
+      }
+      break;
+    case SLASH:
+      if (isNumber(left) && isLiteral(right, 1.0)) {
+        optimizedExpr = left;
+        return {};
+      }
+      break;
+    case MINUS:
+      if (isNumber(left) && isLiteral(right, 0.0) &&
+          !std::signbit(rightLiteral->value.asNumber())) {
+        optimizedExpr = left;
+        return {};
+      }
+      break;
+    default:
+      break;
+    }
+
+    if (left == expr->left && right == expr->right) {
+      optimizedExpr = expr;
+    } else {
+      optimizedExpr = arena.make<Binary>(left, expr->op, right);
+    }
+    return {};
+  }
+
+  Value visitCallExpr(Call *expr) override {
+    Expr *callee = optimize(expr->callee);
+    bool changed = callee != expr->callee;
+
+    std::vector<Expr *> arguments;
+    for (Expr *argument : expr->arguments) {
+      arguments.push_back(optimize(argument));
+      changed = changed || arguments.back() != argument;
+    }
+
+    if (changed) {
+      optimizedExpr =
+          arena.make<Call>(callee, expr->paren, arena.array(arguments));
+    } else {
+      optimizedExpr = expr;
+    }
+    return {};
+  }
+
+  Value visitGroupingExpr(Grouping *expr) override {
+    // Parentheses only matter to the Parser
+    optimizedExpr = optimize(expr->expression);
+    return {};
+  }
+
+  Value visitLiteralExpr(Literal *expr) override {
+    optimizedExpr = expr;
+    return {};
+  }
+
+  Value visitLogicalExpr(Logical *expr) override {
+    Expr *left = optimize(expr->left);
+
+    // The result is one of the operands, so a constant left operand decides
+    // which
+    if (auto *literal = dynamic_cast<Literal *>(left)) {
+      bool truthy = isTruthy(literal->value);
+      if (expr->op.type == OR ? truthy : !truthy) {
+        optimizedExpr = left;
+      } else {
+        optimizedExpr = optimize(expr->right);
+      }
+      return {};
+    }
+
+    Expr *right = optimize(expr->right);
+    if (left == expr->left && right == expr->right) {
+      optimizedExpr = expr;
+    } else {
+      optimizedExpr = arena.make<Logical>(left, expr->op, right);
+    }
+    return {};
+  }
+
+  Value visitUnaryExpr(Unary *expr) override {
+    Expr *right = optimize(expr->right);
+
+    if (auto *literal = dynamic_cast<Literal *>(right)) {
+      if (expr->op.type == BANG) {
+        optimizedExpr =
+            arena.make<Literal>(!isTruthy(literal->value), expr->op.line);
+        return {};
+      }
+      if (literal->value.isNumber()) {
+        optimizedExpr =
+            arena.make<Literal>(-literal->value.asNumber(), expr->op.line);
+        return {};
+      }
+    }
+
+    // -(-x) is x for a number, and !!x is x for a boolean
+    if (auto *inner = dynamic_cast<Unary *>(right);
+        inner != nullptr && inner->op.type == expr->op.type) {
+      if (expr->op.type == MINUS ? isNumber(inner->right)
+                                 : isBool(inner->right)) {
+        optimizedExpr = inner->right;
+        return {};
+      }
+    }
+
+    if (right == expr->right) {
+      optimizedExpr = expr;
+    } else {
+      optimizedExpr = arena.make<Unary>(expr->op, right);
+    }
+    return {};
+  }
+
+  Value visitVariableExpr(Variable *expr) override {
+    optimizedExpr = expr;
+    return {};
+  }
+
+  void visitBlockStmt(Block *stmt) override {
+    std::vector<Stmt *> statements = optimize(stmt->statements);
+    if (std::ranges::equal(statements, stmt->statements)) {
+      optimizedStmt = stmt;
+    } else {
+      auto *block = arena.make<Block>(arena.array(statements));
+      block->captured = stmt->captured;
+      optimizedStmt = block;
+    }
+  }
+
+  void visitExpressionStmt(Expression *stmt) override {
+    Expr *expression = optimize(stmt->expression);
+    if (dynamic_cast<Literal *>(expression) != nullptr) {
+      optimizedStmt = nullptr;
+    } else if (expression == stmt->expression) {
+      optimizedStmt = stmt;
+    } else {
+      optimizedStmt = arena.make<Expression>(expression);
+    }
+  }
+
+  void visitFunctionStmt(Function *stmt) override {
+    std::vector<Stmt *> body = optimize(stmt->body);
+    if (std::ranges::equal(body, stmt->body)) {
+      optimizedStmt = stmt;
+    } else {
+      auto *function =
+          arena.make<Function>(stmt->name, stmt->params, arena.array(body));
+      function->captured = stmt->captured;
+      function->binding = stmt->binding;
+      optimizedStmt = function;
+    }
+  }
+
+  void visitIfStmt(If *stmt) override {
+    Expr *condition = optimize(stmt->condition);
+
+    if (auto *literal = dynamic_cast<Literal *>(condition)) {
+      if (isTruthy(literal->value)) {
+        optimizedStmt = optimize(stmt->thenBranch);
+      } else if (stmt->elseBranch != nullptr) {
+        optimizedStmt = optimize(stmt->elseBranch);
+      } else {
+        optimizedStmt = nullptr;
+      }
+      return;
+    }
+
+    Stmt *thenBranch = optimizeBody(stmt->thenBranch);
+    Stmt *elseBranch =
+        stmt->elseBranch == nullptr ? nullptr : optimize(stmt->elseBranch);
+    if (condition == stmt->condition && thenBranch == stmt->thenBranch &&
+        elseBranch == stmt->elseBranch) {
+      optimizedStmt = stmt;
+    } else {
+      optimizedStmt = arena.make<If>(condition, thenBranch, elseBranch);
+    }
+  }
+
+  void visitPrintStmt(Print *stmt) override {
+    Expr *expression = optimize(stmt->expression);
+    if (expression == stmt->expression) {
+      optimizedStmt = stmt;
+    } else {
+      optimizedStmt = arena.make<Print>(expression);
+    }
+  }
+
+  void visitReturnStmt(Return *stmt) override {
+    Expr *value = stmt->value == nullptr ? nullptr : optimize(stmt->value);
+    if (value == stmt->value) {
+      optimizedStmt = stmt;
+    } else {
+      auto *ret = arena.make<Return>(stmt->keyword, value);
+      ret->tail = stmt->tail;
+      optimizedStmt = ret;
+    }
+  }
+
+  void visitVarStmt(Var *stmt) override {
+    Expr *initializer =
+        stmt->initializer == nullptr ? nullptr : optimize(stmt->initializer);
+    if (initializer == stmt->initializer) {
+      optimizedStmt = stmt;
+    } else {
+      auto *var = arena.make<Var>(stmt->name, initializer);
+      var->binding = stmt->binding;
+      optimizedStmt = var;
+    }
+  }
+
+  void visitWhileStmt(While *stmt) override {
+    Expr *condition = optimize(stmt->condition);
+
+    if (auto *literal = dynamic_cast<Literal *>(condition);
+        literal != nullptr && !isTruthy(literal->value)) {
+      optimizedStmt = nullptr;
+      return;
+    }
+
+    Stmt *body = optimizeBody(stmt->body);
+    if (condition == stmt->condition && body == stmt->body) {
+      optimizedStmt = stmt;
+    } else {
+      optimizedStmt = arena.make<While>(condition, body);
+    }
+  }
+
+private:
+  Expr *optimize(Expr *expr) {
+    expr->accept(*this);
+    return optimizedExpr;
+  }
+
+  Stmt *optimize(Stmt *stmt) {
+    stmt->accept(*this);
+    return optimizedStmt;
+  }
+
+  // For statements that can't be left out, such as the body of a loop
+  Stmt *optimizeBody(Stmt *stmt) {
+    Stmt *optimized = optimize(stmt);
+    if (optimized == nullptr) {
+      return arena.make<Block>(std::span<Stmt *const>{});
+    }
+    return optimized;
+  }
+
+  // Evaluates a binary operator on constants, or returns nothing if that
+  // would be a runtime error
+  static std::optional<Value> fold(TokenType op, const Value &left,
+                                   const Value &right) {
+    switch (op) {
+    case EQUAL_EQUAL:
+      return isEqual(left, right);
+    case BANG_EQUAL:
+      return !isEqual(left, right);
+    case PLUS:
+      if (left.isString() && right.isString()) {
+        std::string chars{left.asString()};
+        chars += right.asString();
+        return Value{LoxString::intern(std::move(chars))};
+      }
+      break;
+    default:
+      break;
+    }
+
+    if (!left.isNumber() || !right.isNumber()) {
+      return std::nullopt;
+    }
+
+    double a = left.asNumber();
+    double b = right.asNumber();
+    switch (op) {
+    case GREATER:
+      return a > b;
+    case GREATER_EQUAL:
+      return a >= b;
+    case LESS:
+      return a < b;
+    case LESS_EQUAL:
+      return a <= b;
+    case MINUS:
+      return a - b;
+    case PLUS:
+      return a + b;
+    case SLASH:
+      return a / b;
+    case STAR:
+      return a * b;
+    default:
+      return std::nullopt;
+    }
+  }
+
+  static bool isLiteral(Expr *expr, double number) {
+    auto *literal = dynamic_cast<Literal *>(expr);
+    return literal != nullptr && literal->value.isNumber() &&
+           literal->value.asNumber() == number;
+  }
+
+  // Whether evaluating `expr` either produces a number or fails
+  static bool isNumber(Expr *expr) {
+    if (auto *literal = dynamic_cast<Literal *>(expr)) {
+      return literal->value.isNumber();
+    }
+    if (auto *unary = dynamic_cast<Unary *>(expr)) {
+      return unary->op.type == MINUS;
+    }
+    if (auto *binary = dynamic_cast<Binary *>(expr)) {
+      switch (binary->op.type) {
+      case MINUS:
+      case SLASH:
+      case STAR:
+        return true;
+      case PLUS:
+        return isNumber(binary->left) || isNumber(binary->right);
+      default:
+        return false;
+      }
+    }
+    return false;
+  }
+
+  // Whether evaluating `expr` either produces a boolean or fails
+  static bool isBool(Expr *expr) {
+    if (auto *literal = dynamic_cast<Literal *>(expr)) {
+      return literal->value.isBool();
+    }
+    if (auto *unary = dynamic_cast<Unary *>(expr)) {
+      return unary->op.type == BANG;
+    }
+    if (auto *binary = dynamic_cast<Binary *>(expr)) {
+      switch (binary->op.type) {
+      case BANG_EQUAL:
+      case EQUAL_EQUAL:
+      case GREATER:
+      case GREATER_EQUAL:
+      case LESS:
+      case LESS_EQUAL:
+        return true;
+      default:
+        return false;
+      }
+    }
+    return false;
+  }
+};
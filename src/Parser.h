@@ -1,12 +1,15 @@
 #pragma once
 
+#include "Arena.h"
 #include "Error.h"
 #include "Expr.h"
+#include "Program.h"
+#include "Scanner.h"
 #include "Stmt.h"
 #include "Token.h"
 #include "TokenType.h"
 #include <cassert>
-#include <memory> // std::shared_ptr, std::make_shared, std::dynamic_pointer_cast
+#include <memory> // std::shared_ptr, std::make_shared
 #include <vector>
 
 class Parser {
@@ -14,24 +17,72 @@ class Parser {
     using std::runtime_error::runtime_error;
   };
 
-  const std::vector<Token> &tokens;
+  // When streaming, only the tokens of the declaration being parsed, scanned
+  // as the parser reaches them
+  std::vector<Token> tokens;
+  Scanner *scanner = nullptr;
   int current = 0;
+  // Owns every node this parser creates
+  std::shared_ptr<Arena> arena = std::make_shared<Arena>();
+  // Number of functions declared so far
+  int functions = 0;
+  ErrorReporter &errors;
 
 public:
-  Parser(const std::vector<Token> &tokens) : tokens{tokens} {}
+  Parser(std::vector<Token> tokens, ErrorReporter &errors)
+      : tokens{std::move(tokens)}, errors{errors} {}
 
-  std::vector<std::shared_ptr<Stmt>> parse() {
-    std::vector<std::shared_ptr<Stmt>> statements{};
+  // Parses a stream with next()
+  Parser(Scanner &scanner, ErrorReporter &errors)
+      : scanner{&scanner}, errors{errors} {}
+
+  Program parse() {
+    std::vector<Stmt *> statements{};
     while (!isAtEnd()) {
       statements.push_back(declaration());
     }
 
-    return statements;
+    // The caller attaches the Source the tokens view
+    return Program{nullptr, arena, std::move(statements), functions > 0};
+  }
+
+  // Parses the next top-level declaration of a stream into a Program of its
+  // own, with its own arena, so that it can be freed once it has run. The
+  // Program has no statements at the end of the stream.
+  Program next() {
+    for (;;) {
+      // The last declaration may have looked at the token after it
+      if (static_cast<size_t>(current) < tokens.size()) {
+        scanner->unscan();
+      }
+      tokens.clear();
+      current = 0;
+      scanner->mark();
+      std::shared_ptr<const Source> chunk = scanner->currentChunk();
+      arena = std::make_shared<Arena>();
+      functions = 0;
+
+      std::vector<Stmt *> statements;
+      if (!isAtEnd()) {
+        statements.push_back(declaration());
+      }
+
+      // A declaration's tokens must all view the Source its Program keeps.
+      // If the Scanner moved on to a new chunk midway, that chunk holds the
+      // whole declaration, so parse it again from there.
+      if (scanner->currentChunk() != chunk && !errors.hadError) {
+        tokens.clear();
+        scanner->rewind();
+        continue;
+      }
+
+      return Program{chunk, arena, std::move(statements), functions > 0};
+    }
   }
 
 private:
   // Statements
-  std::shared_ptr<Stmt> declaration() {
+  Stmt *declaration() {
     try {
       if (match(FUN)) {
         return function("function");
@@ -47,20 +98,20 @@ private:
     }
   }
 
-  std::shared_ptr<Stmt> varDeclaration() {
+  Stmt *varDeclaration() {
     Token name = consume(IDENTIFIER, "Expect variable name.");
 
-    std::shared_ptr<Expr>(initializer) = nullptr;
+    Expr *initializer = nullptr;
     if (match(EQUAL)) {
       initializer = expression();
     }
 
     consume(SEMICOLON, "Expect ';' after variable declaration");
 
-    return std::make_shared<Var>(std::move(name), initializer);
+    return arena->make<Var>(std::move(name), initializer);
   }
 
-  std::shared_ptr<Stmt> statement() {
+  Stmt *statement() {
     if (match(FOR)) {
       return forStatement();
     }
@@ -77,16 +128,16 @@ private:
       return whileStatement();
     }
     if (match(LEFT_BRACE)) {
-      return std::make_shared<Block>(block());
+      return arena->make<Block>(arena->array(block()));
     }
 
     return expressionStatement();
   }
 
-  std::shared_ptr<Stmt> forStatement() {
+  Stmt *forStatement() {
     consume(LEFT_PAREN, "Expect '(' after 'for'.");
 
-    std::shared_ptr<Stmt> initializer;
+    Stmt *initializer;
     if (match(SEMICOLON)) {
       initializer = nullptr;
     } else if (match(VAR)) {
@@ -95,81 +146,81 @@ private:
       initializer = expressionStatement();
     }
 
-    std::shared_ptr<Expr> condition = nullptr;
+    Expr *condition = nullptr;
     if (!check(SEMICOLON)) {
       condition = expression();
     }
-    consume(SEMICOLON, "Expect ';' after loop condition.");
+    Token semicolon = consume(SEMICOLON, "Expect ';' after loop condition.");
 
-    std::shared_ptr<Expr> increment = nullptr;
+    Expr *increment = nullptr;
     if (!check(RIGHT_PAREN)) {
       increment = expression();
     }
     consume(RIGHT_PAREN, "Expect ')' after 'for' clauses.");
 
-    std::shared_ptr<Stmt> body = statement();
+    Stmt *body = statement();
 
     if (increment != nullptr) {
-      body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>>{
-          body, std::make_shared<Expression>(increment)});
+      body = arena->make<Block>(arena->array(std::vector<Stmt *>{
+          body, arena->make<Expression>(increment)}));
     }
 
     if (condition == nullptr) {
-      condition = std::make_shared<Literal>(true);
+      condition = arena->make<Literal>(true, semicolon.line);
     }
 
-    body = std::make_shared<While>(condition, body);
+    body = arena->make<While>(condition, body);
 
     if (initializer != nullptr) {
-      body = std::make_shared<Block>(
-          std::vector<std::shared_ptr<Stmt>>{initializer, body});
+      body = arena->make<Block>(
+          arena->array(std::vector<Stmt *>{initializer, body}));
     }
 
     return body;
   }
 
-  std::shared_ptr<Stmt> ifStatement() {
+  Stmt *ifStatement() {
     consume(LEFT_PAREN, "Expect '(' after 'if'.");
-    std::shared_ptr<Expr> condition = expression();
+    Expr *condition = expression();
     consume(RIGHT_PAREN, "Expect ')' after 'if'.");
 
-    std::shared_ptr<Stmt> thenBranch = statement();
-    std::shared_ptr<Stmt> elseBranch = nullptr;
+    Stmt *thenBranch = statement();
+    Stmt *elseBranch = nullptr;
     if (match(ELSE)) {
       elseBranch = statement();
     }
 
-    return std::make_shared<If>(condition, thenBranch, elseBranch);
+    return arena->make<If>(condition, thenBranch, elseBranch);
   }
 
-  std::shared_ptr<Stmt> printStatement() {
-    std::shared_ptr<Expr> value = expression();
+  Stmt *printStatement() {
+    Expr *value = expression();
     consume(SEMICOLON, "Expect ';' after value.");
-    return std::make_shared<Print>(value);
+    return arena->make<Print>(value);
   }
 
-  std::shared_ptr<Stmt> returnStatement() {
+  Stmt *returnStatement() {
     Token keyword = previous();
-    std::shared_ptr<Expr> value = nullptr;
+    Expr *value = nullptr;
     if (!check(SEMICOLON)) {
       value = expression();
     }
 
     consume(SEMICOLON, "Expect ';' after value.");
-    return std::make_shared<Return>(keyword, value);
+    return arena->make<Return>(keyword, value);
   }
 
-  std::shared_ptr<Stmt> whileStatement() {
+  Stmt *whileStatement() {
     consume(LEFT_PAREN, "Expect, '(' after 'while'.");
-    std::shared_ptr<Expr> condition = expression();
+    Expr *condition = expression();
     consume(RIGHT_PAREN, "Expect, ')' after condition.");
-    std::shared_ptr<Stmt> body = statement();
+    Stmt *body = statement();
 
-    return std::make_shared<While>(condition, body);
+    return arena->make<While>(condition, body);
   }
 
-  std::vector<std::shared_ptr<Stmt>> block() {
-    std::vector<std::shared_ptr<Stmt>> statements;
+  std::vector<Stmt *> block() {
+    std::vector<Stmt *> statements;
 
     while (!check(RIGHT_BRACE) && !isAtEnd()) {
       statements.push_back(declaration());
@@ -179,13 +230,14 @@ private:
     return statements;
   }
 
-  std::shared_ptr<Stmt> expressionStatement() {
-    std::shared_ptr<Expr> expr = expression();
+  Stmt *expressionStatement() {
+    Expr *expr = expression();
     consume(SEMICOLON, "Expect ';' after expression.");
-    return std::make_shared<Expression>(expr);
+    return arena->make<Expression>(expr);
   }
 
-  std::shared_ptr<Function> function(const std::string &kind) {
+  Function *function(const std::string &kind) {
+    functions++;
     Token name = consume(IDENTIFIER, "Expect " + kind + " name.");
 
     consume(LEFT_PAREN, "Expect '(' after " + kind + " name.");
@@ -201,30 +253,29 @@ private:
     consume(RIGHT_PAREN, "Expect ')' after parameters.");
 
     consume(LEFT_BRACE, "Expect '{' before " + kind + " body.");
-    std::vector<std::shared_ptr<Stmt>> body = block();
-    return std::make_shared<Function>(std::move(name), std::move(parameters),
-                                      std::move(body));
+    std::vector<Stmt *> body = block();
+    return arena->make<Function>(std::move(name), arena->array(parameters),
+                                 arena->array(body));
   }
 
   // Expressions
-  std::shared_ptr<Expr> expression() { return assignment(); }
+  Expr *expression() { return assignment(); }
 
-  std::shared_ptr<Expr> assignment() {
-    std::shared_ptr<Expr> expr = logicalOr();
+  Expr *assignment() {
+    Expr *expr = logicalOr();
 
     if (match(EQUAL)) {
       Token equals = previous();
-      std::shared_ptr<Expr> value = assignment();
+      Expr *value = assignment();
 
       // if (expr points to instance of Variable)
-      // => if (dynamic cast of shared_ptr<Expr> expr to
-      //        shared_ptr<Variable> variableExpr does not fail)
-      std::shared_ptr<Variable> variableExpr =
-          std::dynamic_pointer_cast<Variable>(expr);
+      // => if (dynamic cast of Expr *expr to Variable *variableExpr
+      //        does not fail)
+      auto *variableExpr = dynamic_cast<Variable *>(expr);
       if (variableExpr) {
         // convert r-value expression node to l-value Assign node
         Token name = variableExpr->name;
-        return std::make_shared<Assign>(std::move(name), value);
+        return arena->make<Assign>(std::move(name), value);
       }
 
       // call error instead of throwing it,
@@ -235,90 +286,90 @@ private:
     return expr;
   }
 
-  std::shared_ptr<Expr> logicalOr() {
-    std::shared_ptr<Expr> expr = logicalAnd();
+  Expr *logicalOr() {
+    Expr *expr = logicalAnd();
 
     while (match(OR)) {
       Token op = previous();
-      std::shared_ptr<Expr> right = logicalAnd();
-      expr = std::make_shared<Logical>(expr, std::move(op), right);
+      Expr *right = logicalAnd();
+      expr = arena->make<Logical>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expr> logicalAnd() {
-    std::shared_ptr<Expr> expr = equality();
+  Expr *logicalAnd() {
+    Expr *expr = equality();
 
     while (match(AND)) {
       Token op = previous();
-      std::shared_ptr<Expr> right = equality();
-      expr = std::make_shared<Logical>(expr, std::move(op), right);
+      Expr *right = equality();
+      expr = arena->make<Logical>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expr> equality() {
-    std::shared_ptr<Expr> expr = comparison();
+  Expr *equality() {
+    Expr *expr = comparison();
 
     while (match(BANG_EQUAL, EQUAL_EQUAL)) {
       Token op = previous();
-      std::shared_ptr<Expr> right = comparison();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expr *right = comparison();
+      expr = arena->make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expr> comparison() {
-    std::shared_ptr<Expr> expr = term();
+  Expr *comparison() {
+    Expr *expr = term();
 
     while (match(GREATER, GREATER_EQUAL, LESS, LESS_EQUAL)) {
       Token op = previous();
-      std::shared_ptr<Expr> right = term();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expr *right = term();
+      expr = arena->make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expr> term() {
-    std::shared_ptr<Expr> expr = factor();
+  Expr *term() {
+    Expr *expr = factor();
 
     while (match(MINUS, PLUS)) {
       Token op = previous();
-      std::shared_ptr<Expr> right = factor();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expr *right = factor();
+      expr = arena->make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expr> factor() {
-    std::shared_ptr<Expr> expr = unary();
+  Expr *factor() {
+    Expr *expr = unary();
 
     while (match(SLASH, STAR)) {
       Token op = previous();
-      std::shared_ptr<Expr> right = unary();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expr *right = unary();
+      expr = arena->make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expr> unary() {
+  Expr *unary() {
     if (match(MINUS, BANG)) {
       Token op = previous();
-      std::shared_ptr<Expr> right = unary();
-      return std::make_shared<Unary>(std::move(op), right);
+      Expr *right = unary();
+      return arena->make<Unary>(std::move(op), right);
     }
 
     return call();
   }
 
-  std::shared_ptr<Expr> finishCall(std::shared_ptr<Expr> callee) {
-    std::vector<std::shared_ptr<Expr>> arguments;
+  Expr *finishCall(Expr *callee) {
+    std::vector<Expr *> arguments;
     if (!check(RIGHT_PAREN)) {
       do {
         if (arguments.size() >= 255) {
@@ -330,12 +381,12 @@ private:
 
     Token paren = consume(RIGHT_PAREN, "Expect ')' after arguments.");
 
-    return std::make_shared<Call>(callee, std::move(paren),
-                                  std::move(arguments));
+    return arena->make<Call>(callee, std::move(paren),
+                             arena->array(arguments));
   }
 
-  std::shared_ptr<Expr> call() {
-    std::shared_ptr<Expr> expr = primary();
+  Expr *call() {
+    Expr *expr = primary();
 
     while (true) {
       if (match(LEFT_PAREN)) {
@@ -348,29 +399,29 @@ private:
     return expr;
   }
 
-  std::shared_ptr<Expr> primary() {
+  Expr *primary() {
     if (match(FALSE)) {
-      return std::make_shared<Literal>(false);
+      return arena->make<Literal>(false, previous().line);
     }
     if (match(TRUE)) {
-      return std::make_shared<Literal>(true);
+      return arena->make<Literal>(true, previous().line);
     }
     if (match(NIL)) {
-      return std::make_shared<Literal>(nullptr);
+      return arena->make<Literal>(nullptr, previous().line);
     }
 
     if (match(NUMBER, STRING)) {
-      return std::make_shared<Literal>(previous().literal);
+      return arena->make<Literal>(previous().literal(), previous().line);
     }
 
     if (match(IDENTIFIER)) {
-      return std::make_shared<Variable>(previous());
+      return arena->make<Variable>(previous());
     }
 
     if (match(LEFT_PAREN)) {
-      std::shared_ptr<Expr> expr = expression();
+      Expr *expr = expression();
       consume(RIGHT_PAREN, "Expect ')' after expression.");
-      return std::make_shared<Grouping>(expr);
+      return arena->make<Grouping>(expr);
     }
 
     throw error(peek(), "Expect expression.");
@@ -379,7 +430,14 @@ private:
   // helpers
   bool isAtEnd() { return peek().type == END_OF_FILE; }
 
-  Token peek() { return tokens.at(current); }
+  Token peek() {
+    // Scan ahead to the current token when streaming
+    while (scanner != nullptr &&
+           static_cast<size_t>(current) >= tokens.size()) {
+      tokens.push_back(scanner->next());
+    }
+    return tokens.at(current);
+  }
 
   Token previous() { return tokens.at(current - 1); }
 
@@ -440,7 +498,7 @@ private:
       case RETURN:
         return;
       default:
-        continue;
+        break;
       }
 
       advance();
@@ -448,7 +506,7 @@ private:
   }
 
   ParseError error(const Token &token, std::string_view message) {
-    ::error(token, message);
+    errors.error(token, message);
 
     return ParseError{""};
   }
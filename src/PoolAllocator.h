@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Allocator that recycles freed blocks through a per-thread free list for
+// each type, for objects created and destroyed at a high rate (such as
+// the Environment of every block entered and every call made). A freed block
+// goes straight back to the free list, so a loop that allocates one object
+// per iteration reuses the same block every time.
+//
+// A free list only grows to the largest number of objects of its type that
+// were alive at once in its thread, and its blocks are returned to the system
+// when the thread exits.
+template <class T> class PoolAllocator {
+  // Room for the free list's link in every block
+  static constexpr size_t BLOCK_SIZE =
+      sizeof(T) < sizeof(void *) ? sizeof(void *) : sizeof(T);
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+  class FreeList {
+    struct Block {
+      Block *next;
+    };
+
+    Block *head = nullptr;
+    // Once the blocks are freed at thread exit, objects destroyed after that
+    // are freed directly
+    bool released = false;
+
+    // Frees the free list's blocks when its thread exits
+    struct Releaser {
+      FreeList &list;
+
+      ~Releaser() { list.release(); }
+    };
+
+    void release() {
+      while (head != nullptr) {
+        Block *block = head;
+        head = block->next;
+        ::operator delete(block);
+      }
+      released = true;
+    }
+
+  public:
+    void *allocate() {
+      if (head == nullptr) {
+        // Only set up once the thread has a block to free, off the fast path
+        thread_local Releaser releaser{*this};
+        return ::operator new(BLOCK_SIZE);
+      }
+      Block *block = head;
+      head = block->next;
+      return block;
+    }
+
+    void deallocate(void *pointer) {
+      if (released) {
+        ::operator delete(pointer);
+        return;
+      }
+      auto *block = static_cast<Block *>(pointer);
+      block->next = head;
+      head = block;
+    }
+
+    // The list itself is trivially destructible, so objects freed during
+    // thread or static destruction, even after its Releaser has run, can
+    // still reach it
+    static FreeList &local() {
+      thread_local FreeList list;
+      return list;
+    }
+  };
+
+public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <class U> PoolAllocator(const PoolAllocator<U> & /*other*/) {}
+
+  T *allocate(size_t n) {
+    if (n != 1) {
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T *>(FreeList::local().allocate());
+  }
+
+  void deallocate(T *pointer, size_t n) {
+    if (n != 1) {
+      ::operator delete(pointer);
+      return;
+    }
+    FreeList::local().deallocate(pointer);
+  }
+
+  template <class U>
+  bool operator==(const PoolAllocator<U> & /*other*/) const {
+    return true;
+  }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Deterministic per-function profiler. Engines report every call to a Lox
+// function through a Profiler::Call, and the profiler accumulates call counts,
+// inclusive time and self time per function declaration.
+class Profiler {
+  using Clock = std::chrono::steady_clock;
+
+  struct Function {
+    std::string name;
+    int line;
+    std::uint64_t calls = 0;
+    Clock::duration inclusive{};
+    Clock::duration self{};
+    // Calls currently on the stack, so recursive calls aren't counted twice
+    // towards inclusive time
+    int active = 0;
+  };
+
+  struct Frame {
+    Function *function;
+    Clock::time_point start;
+    Clock::duration children{};
+  };
+
+  // Keyed by declaration, which outlives the run
+  std::unordered_map<const void *, Function> functions;
+  std::vector<Frame> stack;
+
+public:
+  enum class Format : std::uint8_t {
+    CSV,
+    JSON,
+  };
+
+  // Times one call for as long as it is in scope
+  class Call {
+    Profiler &profiler;
+
+  public:
+    Call(Profiler &profiler, const void *declaration, std::string_view name,
+         int line)
+        : profiler{profiler} {
+      profiler.enter(declaration, name, line);
+    }
+    Call(const Call &) = delete;
+    Call &operator=(const Call &) = delete;
+    ~Call() { profiler.exit(); }
+  };
+
+  void report(std::ostream &out, Format format) const {
+    std::vector<const Function *> sorted;
+    for (const auto &[declaration, function] : functions) {
+      sorted.push_back(&function);
+    }
+    std::ranges::sort(sorted, [](const Function *a, const Function *b) {
+      if (a->self != b->self) {
+        return a->self > b->self;
+      }
+      return a->line < b->line;
+    });
+
+    if (format == Format::CSV) {
+      out << "function,line,calls,inclusive_ns,self_ns\n";
+      for (const Function *function : sorted) {
+        out << function->name << ',' << function->line << ','
+            << function->calls << ',' << nanoseconds(function->inclusive)
+            << ',' << nanoseconds(function->self) << '\n';
+      }
+      return;
+    }
+
+    out << "[\n";
+    for (size_t i = 0; i < sorted.size(); i++) {
+      const Function *function = sorted[i];
+      out << "  {\"function\": \"" << function->name
+          << "\", \"line\": " << function->line
+          << ", \"calls\": " << function->calls
+          << ", \"inclusive_ns\": " << nanoseconds(function->inclusive)
+          << ", \"self_ns\": " << nanoseconds(function->self) << '}'
+          << (i + 1 < sorted.size() ? "," : "") << '\n';
+    }
+    out << "]\n";
+  }
+
+private:
+  void enter(const void *declaration, std::string_view name, int line) {
+    Function &function =
+        functions.try_emplace(declaration, std::string{name}, line)
+            .first->second;
+    function.calls++;
+    function.active++;
+    stack.push_back(Frame{&function, Clock::now()});
+  }
+
+  void exit() {
+    Frame frame = stack.back();
+    stack.pop_back();
+
+    Clock::duration elapsed = Clock::now() - frame.start;
+    Function &function = *frame.function;
+    function.self += elapsed - frame.children;
+    if (--function.active == 0) {
+      function.inclusive += elapsed;
+    }
+    if (!stack.empty()) {
+      stack.back().children += elapsed;
+    }
+  }
+
+  static std::int64_t nanoseconds(Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+        .count();
+  }
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Arena.h"
+#include "Source.h"
+#include "Stmt.h"
+#include <memory>
+#include <vector>
+
+// The result of parsing a source: its top-level statements, the arena that
+// owns every node reachable from them, and the source their tokens view.
+struct Program {
+  std::shared_ptr<const Source> source;
+  std::shared_ptr<Arena> arena;
+  std::vector<Stmt *> statements;
+  // Whether it declares any functions. The functions' syntax trees, and so
+  // the whole Program, must then outlive its run.
+  bool declaresFunctions = false;
+};
@@ -1,13 +1,45 @@
 #pragma once
 
 #include "Error.h"
-#include "Interpreter.h"
+#include "Expr.h"
+#include "Stmt.h"
+#include "SymbolTable.h"
 #include <map>
+#include <span>
+#include <string>
 #include <vector>
 
+// Resolves every local variable to where it will be stored at runtime.
+//
+// Scopes that no closure captures keep their locals on the engine's value
+// stack; only captured scopes get an Environment. Whether a scope is
+// captured is only known once the whole scope has been seen, so the Resolver
+// makes two passes over the program: the first marks the captured scopes, and
+// the second binds every variable.
 class Resolver : public ExprVisitor, public StmtVisitor {
-  Interpreter &interpreter;
-  std::vector<std::map<std::string, bool>> scopes;
+  // A local declared in one of the enclosing scopes. `slot` is its index
+  // among the scope's locals.
+  struct Local {
+    bool defined;
+    int slot;
+  };
+
+  struct Scope {
+    std::map<Symbol, Local> locals;
+    // Flag in the Block or Function that opened the scope, set when a nested
+    // function refers to one of its locals
+    bool *captured;
+    // Number of functions enclosing the scope
+    int function;
+    // For a scope on the value stack, the frame slot of its first local
+    int stackBase;
+  };
+
+  std::vector<Scope> scopes;
+  // Number of functions enclosing the code being resolved
+  int functions = 0;
+  // Set during the first pass, which only marks captured scopes
+  bool marking = false;
 
   enum class FunctionType : std::uint8_t {
     NONE,
@@ -15,169 +47,207 @@ class Resolver : public ExprVisitor, public StmtVisitor {
   };
 
   FunctionType currentFunction = FunctionType::NONE;
+  ErrorReporter &errors;
 
 public:
-  Resolver(Interpreter &interpreter) : interpreter{interpreter} {};
+  Resolver(ErrorReporter &errors) : errors{errors} {}
 
-  void resolve(const std::vector<std::shared_ptr<Stmt>> &statements) {
-    for (const std::shared_ptr<Stmt> &statement : statements) {
-      resolve(statement);
-    }
+  void resolve(std::span<Stmt *const> statements) {
+    marking = true;
+    resolveStatements(statements);
+    marking = false;
+    resolveStatements(statements);
   }
 
-  std::any visitBlockStmt(const std::shared_ptr<Block> stmt) override {
-    beginScope();
-    resolve(stmt->statements);
+  void visitBlockStmt(Block *stmt) override {
+    beginScope(stmt->captured);
+    resolveStatements(stmt->statements);
     endScope();
-    return {};
   }
 
-  std::any
-  visitExpressionStmt(const std::shared_ptr<Expression> stmt) override {
+  void visitExpressionStmt(Expression *stmt) override {
     resolve(stmt->expression);
-    return {};
   }
 
-  std::any visitFunctionStmt(const std::shared_ptr<Function> stmt) override {
-    declare(stmt->name);
+  void visitFunctionStmt(Function *stmt) override {
+    declare(stmt->name, &stmt->binding);
     define(stmt->name);
 
     resolveFunction(stmt, FunctionType::FUNCTION);
-    return {};
   }
 
-  std::any visitIfStmt(const std::shared_ptr<If> stmt) override {
+  void visitIfStmt(If *stmt) override {
     resolve(stmt->condition);
     resolve(stmt->thenBranch);
     if (stmt->elseBranch != nullptr) {
       resolve(stmt->elseBranch);
     }
-    return {};
   }
 
-  std::any visitPrintStmt(const std::shared_ptr<Print> stmt) override {
+  void visitPrintStmt(Print *stmt) override {
     resolve(stmt->expression);
-    return {};
   }
 
-  std::any visitReturnStmt(const std::shared_ptr<Return> stmt) override {
+  void visitReturnStmt(Return *stmt) override {
     if (currentFunction == FunctionType::NONE) {
-      error(stmt->keyword, "Can't return from top-level code.");
+      report(stmt->keyword, "Can't return from top-level code.");
     }
 
     if (stmt->value != nullptr) {
       resolve(stmt->value);
     }
-    return {};
+
+    // Nothing is left to do in this function once the call returns, so the
+    // engines may run it in place of the current call
+    stmt->tail = dynamic_cast<Call *>(stmt->value) != nullptr;
   }
 
-  std::any visitVarStmt(const std::shared_ptr<Var> stmt) override {
-    declare(stmt->name);
+  void visitVarStmt(Var *stmt) override {
+    declare(stmt->name, &stmt->binding);
     if (stmt->initializer != nullptr) {
       resolve(stmt->initializer);
     }
     define(stmt->name);
-    return {};
   }
 
-  std::any visitWhileStmt(const std::shared_ptr<While> stmt) override {
+  void visitWhileStmt(While *stmt) override {
     resolve(stmt->condition);
     resolve(stmt->body);
-    return {};
   }
 
-  std::any visitAssignExpr(const std::shared_ptr<Assign> expr) override {
+  Value visitAssignExpr(Assign *expr) override {
     resolve(expr->value);
-    resolveLocal(expr, expr->name);
+    resolveLocal(expr->binding, expr->name);
     return {};
   }
 
-  std::any visitBinaryExpr(const std::shared_ptr<Binary> expr) override {
+  Value visitBinaryExpr(Binary *expr) override {
     resolve(expr->left);
     resolve(expr->right);
     return {};
   }
 
-  std::any visitCallExpr(const std::shared_ptr<Call> expr) override {
+  Value visitCallExpr(Call *expr) override {
     resolve(expr->callee);
 
-    for (const std::shared_ptr<Expr> &argument : expr->arguments) {
+    for (Expr *argument : expr->arguments) {
       resolve(argument);
     }
 
     return {};
   }
 
-  std::any visitGroupingExpr(const std::shared_ptr<Grouping> expr) override {
+  Value visitGroupingExpr(Grouping *expr) override {
     resolve(expr->expression);
     return {};
   }
 
-  std::any visitLiteralExpr(
-      [[maybe_unused]] const std::shared_ptr<Literal> expr) override {
+  Value visitLiteralExpr(
+      [[maybe_unused]] Literal *expr) override {
     return {};
   }
 
-  std::any visitLogicalExpr(const std::shared_ptr<Logical> expr) override {
+  Value visitLogicalExpr(Logical *expr) override {
     resolve(expr->left);
     resolve(expr->right);
     return {};
   }
 
-  std::any visitUnaryExpr(const std::shared_ptr<Unary> expr) override {
+  Value visitUnaryExpr(Unary *expr) override {
     resolve(expr->right);
     return {};
   }
 
-  std::any visitVariableExpr(const std::shared_ptr<Variable> expr) override {
+  Value visitVariableExpr(Variable *expr) override {
     if (!scopes.empty()) {
-      std::map<std::string, bool> &scope = scopes.back();
-      if (scope.contains(expr->name.lexeme) && !scope[expr->name.lexeme]) {
-        error(expr->name, "Can't read local variable in its own initializer.");
+      std::map<Symbol, Local> &scope = scopes.back().locals;
+      if (scope.contains(expr->name.symbol()) &&
+          !scope[expr->name.symbol()].defined) {
+        report(expr->name,
+               "Can't read local variable in its own initializer.");
       }
     }
 
-    resolveLocal(expr, expr->name);
+    resolveLocal(expr->binding, expr->name);
     return {};
   }
 
 private:
-  void resolve(const std::shared_ptr<Stmt> &stmt) { stmt->accept(*this); }
+  void resolve(Stmt *stmt) { stmt->accept(*this); }
 
-  void resolve(const std::shared_ptr<Expr> &expr) { expr->accept(*this); }
+  void resolve(Expr *expr) { expr->accept(*this); }
 
-  void resolveFunction(const std::shared_ptr<Function> &function,
+  void resolveStatements(std::span<Stmt *const> statements) {
+    for (Stmt *statement : statements) {
+      resolve(statement);
+    }
+  }
+
+  // Errors are reported by the second pass only
+  void report(const Token &token, std::string_view message) const {
+    if (!marking) {
+      errors.error(token, message);
+    }
+  }
+
+  void resolveFunction(Function *function,
                        FunctionType type) {
     FunctionType enclosingFunction = currentFunction;
     currentFunction = type;
+    functions++;
 
-    beginScope();
+    beginScope(function->captured);
     for (const Token &param : function->params) {
       declare(param);
       define(param);
     }
-    resolve(function->body);
+    resolveStatements(function->body);
     endScope();
 
+    functions--;
     currentFunction = enclosingFunction;
   }
 
-  void beginScope() { scopes.push_back(std::map<std::string, bool>{}); }
+  void beginScope(bool &captured) {
+    if (marking) {
+      captured = false;
+    }
+
+    // A scope on the stack starts where the innermost enclosing one of the
+    // same function currently ends
+    int stackBase = 0;
+    for (auto scope = scopes.rbegin();
+         scope != scopes.rend() && scope->function == functions; ++scope) {
+      if (!*scope->captured) {
+        stackBase =
+            scope->stackBase + static_cast<int>(scope->locals.size());
+        break;
+      }
+    }
+
+    scopes.push_back(Scope{{}, &captured, functions, stackBase});
+  }
 
   void endScope() { scopes.pop_back(); }
 
-  void declare(const Token &name) {
+  // `binding`, if given, is set to where the variable is stored
+  void declare(const Token &name, Binding *binding = nullptr) {
     if (scopes.empty()) {
       return;
     }
 
-    std::map<std::string, bool> &scope = scopes.back();
-    if (scope.contains(name.lexeme)) {
-      error(name,
-            "A variable with this name already exists in the current scope.");
+    Scope &scope = scopes.back();
+    if (scope.locals.contains(name.symbol())) {
+      report(name,
+             "A variable with this name already exists in the current scope.");
     }
 
-    scope[name.lexeme] = false;
+    int slot = static_cast<int>(scope.locals.size());
+    scope.locals[name.symbol()] = Local{false, slot};
+
+    if (binding != nullptr && !marking) {
+      *binding = bind(scopes.size() - 1, slot);
+    }
   }
 
   void define(const Token &name) {
@@ -185,16 +255,42 @@ private:
       return;
     }
 
-    std::map<std::string, bool> &scope = scopes.back();
-    scope[name.lexeme] = true;
+    scopes.back().locals[name.symbol()].defined = true;
   }
 
-  void resolveLocal(const std::shared_ptr<Expr> &expr, const Token &name) {
-    for (int i = scopes.size() - 1; i >= 0; i--) {
-      if (scopes[i].contains(name.lexeme)) {
-        interpreter.resolve(expr, scopes.size() - 1 - i);
-        return;
+  void resolveLocal(Binding &binding, const Token &name) {
+    for (size_t i = scopes.size(); i-- > 0;) {
+      auto found = scopes[i].locals.find(name.symbol());
+      if (found == scopes[i].locals.end()) {
+        continue;
+      }
+
+      if (marking) {
+        // Referred to from a nested function
+        if (scopes[i].function != functions) {
+          *scopes[i].captured = true;
+        }
+      } else {
+        binding = bind(i, found->second.slot);
+      }
+      return;
+    }
+  }
+
+  // Where local `slot` of scope `i` is stored, seen from the current scope
+  Binding bind(size_t i, int slot) const {
+    const Scope &scope = scopes[i];
+    if (!*scope.captured) {
+      return Binding{.slot = scope.stackBase + slot, .onStack = true};
+    }
+
+    // Scopes on the stack have no Environment in the chain
+    int depth = 0;
+    for (size_t j = i + 1; j < scopes.size(); j++) {
+      if (*scopes[j].captured) {
+        depth++;
       }
     }
+    return Binding{.depth = depth, .slot = slot};
   }
 };
@@ -1,25 +1,100 @@
 #pragma once
 
 #include "Error.h"
+#include "Source.h"
+#include "SourceReader.h"
 #include "Token.h"
 #include "TokenType.h"
+#include <algorithm>
+#include <charconv>
 #include <map>
+#include <memory>
 #include <string>
 #include <string_view>
-#include <utility>
 #include <vector>
 
+// Scans a whole source at once with scanTokens(), or a stream a token at a
+// time with next().
+//
+// A stream is scanned a chunk at a time. Tokens view the chunk they were
+// scanned from, so a token never straddles two: when the Scanner runs out of
+// text, it copies what it still needs of the chunk into the next one.
 class Scanner {
-  static const std::map<std::string, TokenType> keywords;
+  static const std::map<std::string_view, TokenType> keywords;
 
   std::string_view source;
   std::vector<Token> tokens;
   size_t start = 0;
   size_t current = 0;
   int line = 1;
+  ErrorReporter &errors;
+
+  // When streaming: where the rest of the text comes from, and the chunk of
+  // it `source` views
+  SourceReader *reader = nullptr;
+  std::shared_ptr<const Source> chunk;
+  // Line `start` is on
+  int startLine = 1;
+  // Where the last token next() returned starts, for unscan()
+  size_t lastStart = 0;
+  int lastLine = 1;
+  // Set by mark(): the text from here on is kept in the next chunk
+  size_t marked = 0;
+  int markedLine = 1;
 
 public:
-  Scanner(std::string_view source) : source{source} {};
+  Scanner(std::string_view source, ErrorReporter &errors)
+      : source{source}, errors{errors} {};
+
+  Scanner(SourceReader &reader, ErrorReporter &errors)
+      : errors{errors}, reader{&reader},
+        chunk{std::make_shared<const Source>("")} {}
+
+  // Returns the next token, and END_OF_FILE at the end
+  Token next() {
+    while (tokens.empty()) {
+      // We are at the beginning of the next lexeme
+      start = current;
+      startLine = line;
+      if (isAtEnd()) {
+        tokens.emplace_back(END_OF_FILE, "", line);
+        break;
+      }
+      scanToken();
+    }
+
+    lastStart = start;
+    lastLine = startLine;
+    Token token = tokens.back();
+    tokens.clear();
+    return token;
+  }
+
+  // Backs up so that next() returns the token it last returned again
+  void unscan() {
+    current = lastStart;
+    line = lastLine;
+  }
+
+  // Marks the current position for rewind(). Chunks read later start no
+  // later than the mark, so everything scanned since can be scanned again
+  // from whichever chunk is current.
+  void mark() {
+    marked = current;
+    markedLine = line;
+  }
+
+  // Goes back to the mark, to scan again from there
+  void rewind() {
+    current = marked;
+    line = markedLine;
+    tokens.clear();
+  }
+
+  // The chunk being scanned, when streaming
+  [[nodiscard]] const std::shared_ptr<const Source> &currentChunk() const {
+    return chunk;
+  }
 
   std::vector<Token> scanTokens() {
     while (!isAtEnd()) {
@@ -28,7 +103,7 @@ public:
       scanToken();
     }
 
-    tokens.emplace_back(END_OF_FILE, "", nullptr, line);
+    tokens.emplace_back(END_OF_FILE, "", line);
     return tokens;
   }
 
@@ -111,7 +186,7 @@ private:
       } else if (isAlpha(c)) {
         identifier();
       } else {
-        error(line, "Unexpected character.");
+        errors.error(line, "Unexpected character.");
       }
       break;
     }
@@ -122,7 +197,7 @@ private:
       advance();
     }
 
-    std::string text(source.substr(start, current - start));
+    std::string_view text = source.substr(start, current - start);
 
     TokenType type;
     auto match = keywords.find(text);
@@ -149,9 +224,10 @@ private:
       }
     }
 
-    std::string strValue(source.substr(start, current - start));
-    double value = std::stod(strValue);
-    addToken(NUMBER, value);
+    std::string_view text = source.substr(start, current - start);
+    double value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    tokens.emplace_back(text, value, line);
   }
 
   void string() {
@@ -163,16 +239,15 @@ private:
     }
 
     if (isAtEnd()) {
-      error(line, "Unterminated string.");
+      errors.error(line, "Unterminated string.");
       return;
     }
 
     // Consume closing '"'
     advance();
 
-    // Trim surrounding quotes
-    std::string value{source.substr(start + 1, current - start - 2)};
-    addToken(STRING, value);
+    // The value is made from the lexeme when the Parser needs it
+    addToken(STRING);
   }
 
   bool match(char expected) {
@@ -195,7 +270,7 @@ private:
   }
 
   char peekNext() {
-    if (current + 1 >= source.size()) {
+    if (!available(2)) {
       return '\0';
     }
     return source.at(current + 1);
@@ -209,19 +284,51 @@ private:
 
   bool isDigit(char c) { return '0' <= c && c <= '9'; }
 
-  bool isAtEnd() { return current >= source.size(); }
+  bool isAtEnd() { return !available(1); }
 
-  char advance() { return source.at(current++); }
+  // Whether there are `count` more characters to scan, reading as many more
+  // chunks of a stream as that takes
+  bool available(size_t count) {
+    while (source.size() - current < count) {
+      if (!readChunk()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Replaces the chunk with one that starts with the text still needed from
+  // it, from the mark or the last token on, followed by more of the stream.
+  // Reads at least as much again as it keeps, so that scanning a declaration
+  // longer than a chunk stays linear.
+  bool readChunk() {
+    if (reader == nullptr) {
+      return false;
+    }
+
+    size_t keep = std::min(marked, lastStart);
+    std::string text{source.substr(keep)};
+    if (!reader->read(text, std::max(SourceReader::CHUNK_SIZE, text.size()))) {
+      return false;
+    }
 
-  void addToken(TokenType type) { addToken(type, nullptr); }
+    chunk = std::make_shared<const Source>(std::move(text));
+    source = chunk->view();
+    start -= keep;
+    current -= keep;
+    lastStart -= keep;
+    marked -= keep;
+    return true;
+  }
+
+  char advance() { return source.at(current++); }
 
-  void addToken(TokenType type, std::any literal) {
-    std::string text{source.substr(start, current - start)};
-    tokens.emplace_back(type, std::move(text), std::move(literal), line);
+  void addToken(TokenType type) {
+    tokens.emplace_back(type, source.substr(start, current - start), line);
   }
 };
 
-const std::map<std::string, TokenType> Scanner::keywords = {
+const std::map<std::string_view, TokenType> Scanner::keywords = {
     {"and", AND},   {"class", CLASS}, {"else", ELSE},     {"false", FALSE},
     {"for", FOR},   {"fun", FUN},     {"if", IF},         {"nil", NIL},
     {"or", OR},     {"print", PRINT}, {"return", RETURN}, {"super", SUPER},
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// The text of a script. Tokens and syntax trees hold views into it, so it must
+// outlive every Program parsed from it. Files are mapped rather than copied.
+class Source {
+  std::string text;
+  void *mapping = nullptr;
+  size_t size = 0;
+
+public:
+  Source(std::string text) : text{std::move(text)} {}
+  Source(const Source &) = delete;
+  Source &operator=(const Source &) = delete;
+
+  ~Source() {
+    if (mapping != nullptr) {
+      munmap(mapping, size);
+    }
+  }
+
+  // Returns nullptr, with errno set, if the file can't be read
+  static std::shared_ptr<Source> map(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+      return nullptr;
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) == -1) {
+      close(fd);
+      return nullptr;
+    }
+
+    auto source = std::make_shared<Source>("");
+    if (info.st_size > 0) {
+      source->size = static_cast<size_t>(info.st_size);
+      source->mapping =
+          mmap(nullptr, source->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (source->mapping == MAP_FAILED) {
+        source->mapping = nullptr;
+        close(fd);
+        return nullptr;
+      }
+    }
+
+    close(fd);
+    return source;
+  }
+
+  [[nodiscard]] std::string_view view() const {
+    if (mapping != nullptr) {
+      return {static_cast<const char *>(mapping), size};
+    }
+    return text;
+  }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+// Reads a script a chunk at a time, for running scripts too large to hold in
+// memory all at once (see Lox::stream). The Scanner asks for the next chunk
+// when it reaches the end of the one it has.
+class SourceReader {
+  int fd;
+  // errno of the read that failed, if one did
+  int failure = 0;
+
+public:
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+  explicit SourceReader(int fd) : fd{fd} {}
+  SourceReader(const SourceReader &) = delete;
+  SourceReader &operator=(const SourceReader &) = delete;
+
+  ~SourceReader() { close(fd); }
+
+  // Returns nullptr, with errno set, if the file can't be opened
+  static std::unique_ptr<SourceReader> open(const char *path) {
+    int file = ::open(path, O_RDONLY);
+    if (file == -1) {
+      return nullptr;
+    }
+    return std::make_unique<SourceReader>(file);
+  }
+
+  // Appends up to `size` more bytes of the file to `text`. Returns false at
+  // the end of the file, or if reading failed (see error()).
+  bool read(std::string &text, size_t size) {
+    size_t end = text.size();
+    text.resize(end + size);
+    ssize_t count = 0;
+    do {
+      count = ::read(fd, text.data() + end, size);
+    } while (count == -1 && errno == EINTR);
+
+    if (count <= 0) {
+      failure = count == -1 ? errno : 0;
+      text.resize(end);
+      return false;
+    }
+    text.resize(end + static_cast<size_t>(count));
+    return true;
+  }
+
+  // The errno of the read that failed, or 0 if none did
+  [[nodiscard]] int error() const { return failure; }
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "Chunk.h"
+#include "ObjFunction.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Follows a function's bytecode down every branch to find how many stack
+// slots its frame uses, counting the callee in slot 0 and the arguments after
+// it. Along the way it checks that no instruction pops the callee, reads a
+// local slot the frame doesn't have yet, or is reached with two different
+// stack depths.
+//
+// The VM sets aside FRAME_SLOTS for every frame and doesn't check its stack
+// as it runs, so the Compiler keeps each function within them and the
+// BytecodeCache rejects cached code that isn't.
+class StackDepth {
+public:
+  static constexpr int FRAME_SLOTS = 512;
+
+  struct Result {
+    // Most slots in use at once
+    int max;
+    // An instruction that leaves that many in use
+    size_t offset;
+  };
+
+  // Returns nothing if the code misuses the stack. Its instructions must be
+  // well formed, with every jump landing on one; code no path reaches is
+  // skipped.
+  static std::optional<Result> measure(const ObjFunction &function) {
+    const std::vector<std::uint8_t> &code = function.chunk.code;
+    // Depth before each instruction, or -1 until a path reaches it
+    std::vector<int> depths(code.size(), -1);
+    std::vector<size_t> pending;
+    auto reach = [&](size_t offset, int depth) {
+      if (offset >= code.size()) {
+        return false;
+      }
+      if (depths[offset] == -1) {
+        depths[offset] = depth;
+        pending.push_back(offset);
+        return true;
+      }
+      return depths[offset] == depth;
+    };
+
+    Result result{function.arity + 1, 0};
+    if (!reach(0, result.max)) {
+      return std::nullopt;
+    }
+    while (!pending.empty()) {
+      size_t offset = pending.back();
+      pending.pop_back();
+      int depth = depths[offset];
+
+      std::uint8_t op = code[offset];
+      size_t operand = 0;
+      if (offset + 2 < code.size()) {
+        operand = (code[offset + 1] << 8) | code[offset + 2];
+      }
+      int pops = 0;
+      int pushes = 0;
+      size_t size = 1;
+      bool next = true;
+      std::optional<size_t> jump;
+      switch (op) {
+      case OP_CONSTANT:
+        pushes = 1;
+        size = 3;
+        break;
+      case OP_NIL:
+      case OP_TRUE:
+      case OP_FALSE:
+      case OP_GET_UPVALUE:
+        pushes = 1;
+        size = op == OP_GET_UPVALUE ? 2 : 1;
+        break;
+      case OP_POP:
+      case OP_PRINT:
+      case OP_CLOSE_UPVALUE:
+        pops = 1;
+        break;
+      case OP_GET_LOCAL:
+      case OP_SET_LOCAL:
+        if (code[offset + 1] >= depth) {
+          return std::nullopt;
+        }
+        pops = op == OP_SET_LOCAL ? 1 : 0;
+        pushes = 1;
+        size = 2;
+        break;
+      case OP_SET_UPVALUE:
+        pops = 1;
+        pushes = 1;
+        size = 2;
+        break;
+      case OP_DEFINE_GLOBAL:
+        pops = 1;
+        size = 5;
+        break;
+      case OP_GET_GLOBAL:
+        pushes = 1;
+        size = 5;
+        break;
+      case OP_SET_GLOBAL:
+        pops = 1;
+        pushes = 1;
+        size = 5;
+        break;
+      case OP_EQUAL:
+      case OP_NOT_EQUAL:
+      case OP_GREATER:
+      case OP_GREATER_EQUAL:
+      case OP_LESS:
+      case OP_LESS_EQUAL:
+      case OP_ADD:
+      case OP_SUBTRACT:
+      case OP_MULTIPLY:
+      case OP_DIVIDE:
+        pops = 2;
+        pushes = 1;
+        break;
+      case OP_NOT:
+      case OP_NEGATE:
+        pops = 1;
+        pushes = 1;
+        break;
+      case OP_JUMP:
+        size = 3;
+        next = false;
+        jump = offset + 3 + operand;
+        break;
+      case OP_JUMP_IF_FALSE:
+        pops = 1;
+        pushes = 1;
+        size = 3;
+        jump = offset + 3 + operand;
+        break;
+      case OP_LOOP:
+        size = 3;
+        next = false;
+        jump = offset + 3 - operand;
+        break;
+      case OP_CALL:
+      case OP_TAIL_CALL:
+        // The callee and its arguments, replaced by the result unless the
+        // call runs in place of this frame
+        pops = code[offset + 1] + 1;
+        pushes = op == OP_CALL ? 1 : 0;
+        size = 2;
+        next = op == OP_CALL;
+        break;
+      case OP_CLOSURE: {
+        const auto *closed =
+            function.chunk.constants[operand].asObj<ObjFunction>();
+        pushes = 1;
+        size = 3 + 2 * static_cast<size_t>(closed->upvalueCount);
+        // A local function captures itself, in the slot the closure goes to
+        for (size_t i = offset + 3; i < offset + size; i += 2) {
+          if (code[i] != 0 && code[i + 1] > depth) {
+            return std::nullopt;
+          }
+        }
+        break;
+      }
+      case OP_RETURN:
+        pops = 1;
+        next = false;
+        break;
+      default:
+        return std::nullopt;
+      }
+
+      if (depth - pops < 1) {
+        return std::nullopt;
+      }
+      int after = depth - pops + pushes;
+      if (after > result.max) {
+        result = {after, offset};
+      }
+      if ((next && !reach(offset + size, after)) ||
+          (jump && !reach(*jump, after))) {
+        return std::nullopt;
+      }
+    }
+    return result;
+  }
+};
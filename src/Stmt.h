@@ -14,116 +14,121 @@ struct While;
 
 // GenerateAst.cpp > defineVisitor()
 struct StmtVisitor {
-  virtual std::any visitBlockStmt(std::shared_ptr<Block> stmt) = 0;
-  virtual std::any visitExpressionStmt(std::shared_ptr<Expression> stmt) = 0;
-  virtual std::any visitFunctionStmt(std::shared_ptr<Function> stmt) = 0;
-  virtual std::any visitIfStmt(std::shared_ptr<If> stmt) = 0;
-  virtual std::any visitPrintStmt(std::shared_ptr<Print> stmt) = 0;
-  virtual std::any visitReturnStmt(std::shared_ptr<Return> stmt) = 0;
-  virtual std::any visitVarStmt(std::shared_ptr<Var> stmt) = 0;
-  virtual std::any visitWhileStmt(std::shared_ptr<While> stmt) = 0;
+  virtual void visitBlockStmt(Block *stmt) = 0;
+  virtual void visitExpressionStmt(Expression *stmt) = 0;
+  virtual void visitFunctionStmt(Function *stmt) = 0;
+  virtual void visitIfStmt(If *stmt) = 0;
+  virtual void visitPrintStmt(Print *stmt) = 0;
+  virtual void visitReturnStmt(Return *stmt) = 0;
+  virtual void visitVarStmt(Var *stmt) = 0;
+  virtual void visitWhileStmt(While *stmt) = 0;
 
   virtual ~StmtVisitor() = default;
 };
 
 struct Stmt {
-  virtual std::any accept(StmtVisitor &visitor) = 0;
+  virtual void accept(StmtVisitor &visitor) = 0;
   virtual ~Stmt() = default;
 };
 
 // GenerateAst.cpp > defineType()
-struct Block : Stmt, public std::enable_shared_from_this<Block> {
-  Block(std::vector<std::shared_ptr<Stmt>> statements)
-      : statements{std::move(statements)} {}
+struct Block : Stmt {
+  Block(std::span<Stmt *const> statements)
+      : statements{statements} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitBlockStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitBlockStmt(this);
   }
 
-  const std::vector<std::shared_ptr<Stmt>> statements;
+  const std::span<Stmt *const> statements;
+  bool captured{};
 };
 
-struct Expression : Stmt, public std::enable_shared_from_this<Expression> {
-  Expression(std::shared_ptr<Expr> expression)
-      : expression{std::move(expression)} {}
+struct Expression : Stmt {
+  Expression(Expr *expression)
+      : expression{expression} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitExpressionStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitExpressionStmt(this);
   }
 
-  const std::shared_ptr<Expr> expression;
+  Expr *const expression;
 };
 
-struct Function : Stmt, public std::enable_shared_from_this<Function> {
-  Function(Token name, std::vector<Token> params, std::vector<std::shared_ptr<Stmt>> body)
-      : name{std::move(name)}, params{std::move(params)}, body{std::move(body)} {}
+struct Function : Stmt {
+  Function(Token name, std::span<const Token> params, std::span<Stmt *const> body)
+      : name{std::move(name)}, params{params}, body{body} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitFunctionStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitFunctionStmt(this);
   }
 
   const Token name;
-  const std::vector<Token> params;
-  const std::vector<std::shared_ptr<Stmt>> body;
+  const std::span<const Token> params;
+  const std::span<Stmt *const> body;
+  bool captured{};
+  Binding binding{};
 };
 
-struct If : Stmt, public std::enable_shared_from_this<If> {
-  If(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> thenBranch, std::shared_ptr<Stmt> elseBranch)
-      : condition{std::move(condition)}, thenBranch{std::move(thenBranch)}, elseBranch{std::move(elseBranch)} {}
+struct If : Stmt {
+  If(Expr *condition, Stmt *thenBranch, Stmt *elseBranch)
+      : condition{condition}, thenBranch{thenBranch}, elseBranch{elseBranch} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitIfStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitIfStmt(this);
   }
 
-  const std::shared_ptr<Expr> condition;
-  const std::shared_ptr<Stmt> thenBranch;
-  const std::shared_ptr<Stmt> elseBranch;
+  Expr *const condition;
+  Stmt *const thenBranch;
+  Stmt *const elseBranch;
 };
 
-struct Print : Stmt, public std::enable_shared_from_this<Print> {
-  Print(std::shared_ptr<Expr> expression)
-      : expression{std::move(expression)} {}
+struct Print : Stmt {
+  Print(Expr *expression)
+      : expression{expression} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitPrintStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitPrintStmt(this);
   }
 
-  const std::shared_ptr<Expr> expression;
+  Expr *const expression;
 };
 
-struct Return : Stmt, public std::enable_shared_from_this<Return> {
-  Return(Token keyword, std::shared_ptr<Expr> value)
-      : keyword{std::move(keyword)}, value{std::move(value)} {}
+struct Return : Stmt {
+  Return(Token keyword, Expr *value)
+      : keyword{std::move(keyword)}, value{value} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitReturnStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitReturnStmt(this);
   }
 
   const Token keyword;
-  const std::shared_ptr<Expr> value;
+  Expr *const value;
+  bool tail{};
 };
 
-struct Var : Stmt, public std::enable_shared_from_this<Var> {
-  Var(Token name, std::shared_ptr<Expr> initializer)
-      : name{std::move(name)}, initializer{std::move(initializer)} {}
+struct Var : Stmt {
+  Var(Token name, Expr *initializer)
+      : name{std::move(name)}, initializer{initializer} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitVarStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitVarStmt(this);
   }
 
   const Token name;
-  const std::shared_ptr<Expr> initializer;
+  Expr *const initializer;
+  Binding binding{};
 };
 
-struct While : Stmt, public std::enable_shared_from_this<While> {
-  While(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> body)
-      : condition{std::move(condition)}, body{std::move(body)} {}
+struct While : Stmt {
+  While(Expr *condition, Stmt *body)
+      : condition{condition}, body{body} {}
 
-  std::any accept(StmtVisitor &visitor) override {
-    return visitor.visitWhileStmt(shared_from_this());
+  void accept(StmtVisitor &visitor) override {
+    return visitor.visitWhileStmt(this);
   }
 
-  const std::shared_ptr<Expr> condition;
-  const std::shared_ptr<Stmt> body;
+  Expr *const condition;
+  Stmt *const body;
 };
 
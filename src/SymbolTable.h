@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using Symbol = std::uint32_t;
+
+// Interns identifier names. Each distinct spelling is stored once and given a
+// small integer id, so identifiers can be compared and hashed as integers.
+class SymbolTable {
+  // A deque never moves its elements, so views into it stay valid
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, Symbol> ids;
+
+public:
+  Symbol intern(std::string_view name) {
+    auto found = ids.find(name);
+    if (found != ids.end()) {
+      return found->second;
+    }
+
+    auto symbol = static_cast<Symbol>(names.size());
+    ids.emplace(names.emplace_back(name), symbol);
+    return symbol;
+  }
+
+  [[nodiscard]] const std::string &name(Symbol symbol) const {
+    return names[symbol];
+  }
+};
+
+// One per thread, like the rest of the runtime's shared state, so Lox
+// instances on different threads can scan and resolve at the same time
+inline thread_local SymbolTable symbols;
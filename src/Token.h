@@ -1,20 +1,52 @@
 #pragma once
 
+#include "LoxString.h"
+#include "SymbolTable.h"
 #include "TokenType.h"
-#include <any>
+#include "Value.h"
 #include <string>
-#include <utility> // for std::move
+#include <string_view>
 
+// A scanned token. Tokens do not own any text: `lexeme` views the Source they
+// were scanned from, so they are small and trivially copyable.
 class Token {
 public:
-  const TokenType type;
-  const std::string lexeme;
-  const std::any literal;
+  // Points into the Source, which must outlive the token
+  const std::string_view lexeme;
+
+private:
+  union {
+    double number; // NUMBER
+    Symbol symbol; // IDENTIFIER
+  } as;
+
+public:
   const int line;
+  const TokenType type;
+
+  Token(TokenType type, std::string_view lexeme, int line)
+      : lexeme{lexeme}, as{.symbol = 0}, line{line}, type{type} {
+    if (type == IDENTIFIER) {
+      as.symbol = symbols.intern(lexeme);
+    }
+  }
+
+  Token(std::string_view lexeme, double number, int line)
+      : lexeme{lexeme}, as{.number = number}, line{line}, type{NUMBER} {}
 
-  Token(TokenType type, std::string lexeme, std::any literal, int line)
-      : type(type), lexeme(std::move(lexeme)), literal(std::move(literal)),
-        line(line) {}
+  // The interned name of an IDENTIFIER
+  [[nodiscard]] Symbol symbol() const { return as.symbol; }
+
+  // The value of a NUMBER or STRING literal
+  [[nodiscard]] Value literal() const {
+    if (type == NUMBER) {
+      return as.number;
+    }
+
+    // Trim surrounding quotes
+    std::string chars{lexeme.substr(1, lexeme.size() - 2)};
+    return Value{LoxString::intern(std::move(chars))};
+  }
 
   [[nodiscard]] std::string toString() const {
     std::string literalStr;
@@ -24,10 +56,10 @@ public:
       literalStr = lexeme;
       break;
     case (STRING):
-      literalStr = std::any_cast<std::string>(literal);
+      literalStr = literal().asString();
       break;
     case (NUMBER):
-      literalStr = std::to_string(std::any_cast<double>(literal));
+      literalStr = std::to_string(as.number);
       break;
     case (TRUE):
       literalStr = "true";
@@ -39,6 +71,8 @@ public:
       literalStr = "nil";
     }
 
-    return ::toString(type) + " " + lexeme + " " + literalStr;
+    return ::toString(type) + " " + std::string{lexeme} + " " + literalStr;
   }
 };
+
+static_assert(sizeof(Token) == 32);
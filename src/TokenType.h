@@ -1,9 +1,10 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <string>
 
-enum TokenType {
+enum TokenType : std::uint8_t {
   // Single-character tokens
   LEFT_PAREN,
   RIGHT_PAREN,
@@ -0,0 +1,450 @@
+#pragma once
+
+#include "Chunk.h"
+#include "Error.h"
+#include "Globals.h"
+#include "NativeFunction.h"
+#include "Natives.h"
+#include "ObjClosure.h"
+#include "ObjFunction.h"
+#include "StackDepth.h"
+#include "SymbolTable.h"
+#include "Value.h"
+#include <algorithm> // std::move
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+// Stack-based virtual machine that executes bytecode produced by the Compiler.
+class VM {
+  static constexpr int FRAMES_MAX = 2048;
+  // Room each frame is guaranteed for its locals and temporaries, which the
+  // Compiler keeps its functions within (see StackDepth)
+  static constexpr int FRAME_SLOTS = StackDepth::FRAME_SLOTS;
+  static constexpr int STACK_MAX = FRAMES_MAX * 64;
+
+  struct CallFrame {
+    ObjClosure *closure;
+    const std::uint8_t *ip;
+    Value *slots;
+  };
+
+  std::vector<Value> stack;
+  Value *stackTop;
+  std::vector<CallFrame> frames;
+  int frameCount = 0;
+  // Upvalues still pointing into the stack, ordered by stack slot
+  std::vector<Value> openUpvalues;
+  // Where print statements write
+  std::ostream &out;
+  ErrorReporter &errors;
+
+public:
+  Globals globals;
+
+  VM(std::ostream &out, ErrorReporter &errors)
+      : stack(STACK_MAX), stackTop{stack.data()}, frames(FRAMES_MAX), out{out},
+        errors{errors} {
+    NativeRegistry::standard().defineAll(globals);
+  }
+
+  void interpret(const Value &script) {
+    push(Value{new ObjClosure{script}});
+    if (call(stackTop[-1].asObj<ObjClosure>(), 0)) {
+      run();
+    }
+  }
+
+private:
+  void push(Value value) { *stackTop++ = std::move(value); }
+
+  Value pop() { return std::move(*--stackTop); }
+
+  Value &peek(int distance) { return stackTop[-1 - distance]; }
+
+  void resetStack() {
+    while (stackTop != stack.data()) {
+      *--stackTop = nullptr;
+    }
+    frameCount = 0;
+    openUpvalues.clear();
+  }
+
+  void runtimeError(const std::string &message) {
+    CallFrame &frame = frames[frameCount - 1];
+    const Chunk &chunk = frame.closure->getFunction()->chunk;
+    size_t instruction = frame.ip - chunk.code.data() - 1;
+    errors.runtimeError(chunk.lines[instruction], message);
+    resetStack();
+  }
+
+  bool checkArity(ObjFunction *function, int argCount) {
+    if (argCount != function->arity) {
+      runtimeError("Expected " + std::to_string(function->arity) +
+                   " arguments but got " + std::to_string(argCount) + ".");
+      return false;
+    }
+    return true;
+  }
+
+  bool call(ObjClosure *closure, int argCount) {
+    ObjFunction *function = closure->getFunction();
+    if (!checkArity(function, argCount)) {
+      return false;
+    }
+
+    if (frameCount == FRAMES_MAX ||
+        stackTop + FRAME_SLOTS > stack.data() + STACK_MAX) {
+      runtimeError("Stack overflow.");
+      return false;
+    }
+
+    CallFrame &frame = frames[frameCount++];
+    frame.closure = closure;
+    frame.ip = function->chunk.code.data();
+    frame.slots = stackTop - argCount - 1;
+    return true;
+  }
+
+  bool callValue(const Value &callee, int argCount) {
+    if (callee.isObjType(ObjType::CLOSURE)) {
+      return call(callee.asObj<ObjClosure>(), argCount);
+    }
+    if (callee.isObjType(ObjType::NATIVE)) {
+      return callNative(argCount);
+    }
+
+    runtimeError("Can only call functions and classes.");
+    return false;
+  }
+
+  // Passes the arguments to the native right where they are on the stack, and
+  // replaces them and the native with its result
+  bool callNative(int argCount) {
+    Value *arguments = stackTop - argCount;
+    Value result;
+    try {
+      result = arguments[-1].asObj<NativeFunction>()->invoke(
+          std::span<const Value>{arguments, static_cast<size_t>(argCount)});
+    } catch (const NativeError &error) {
+      runtimeError(error.what());
+      return false;
+    }
+
+    while (stackTop != arguments - 1) {
+      *--stackTop = nullptr;
+    }
+    push(std::move(result));
+    return true;
+  }
+
+  // Runs the call on top of the stack in place of the current frame, which has
+  // nothing left to do but return its result
+  bool tailCall(int argCount) {
+    Value *callee = stackTop - argCount - 1;
+    if (!callee->isObjType(ObjType::CLOSURE)) {
+      runtimeError("Can only call functions and classes.");
+      return false;
+    }
+    auto *closure = callee->asObj<ObjClosure>();
+    if (!checkArity(closure->getFunction(), argCount)) {
+      return false;
+    }
+
+    CallFrame &frame = frames[frameCount - 1];
+    closeUpvalues(frame.slots);
+    // Slide the callee and its arguments down over the finished frame
+    std::move(callee, stackTop, frame.slots);
+    Value *end = frame.slots + argCount + 1;
+    while (stackTop != end) {
+      *--stackTop = nullptr;
+    }
+
+    frame.closure = closure;
+    frame.ip = closure->getFunction()->chunk.code.data();
+    return true;
+  }
+
+  Value captureUpvalue(Value *local) {
+    auto it = openUpvalues.end();
+    while (it != openUpvalues.begin()) {
+      ObjUpvalue *upvalue = (it - 1)->asObj<ObjUpvalue>();
+      if (upvalue->location == local) {
+        return *(it - 1);
+      }
+      if (upvalue->location < local) {
+        break;
+      }
+      --it;
+    }
+
+    return *openUpvalues.insert(it, Value{new ObjUpvalue{local}});
+  }
+
+  void closeUpvalues(const Value *last) {
+    while (!openUpvalues.empty()) {
+      auto *upvalue = openUpvalues.back().asObj<ObjUpvalue>();
+      if (upvalue->location < last) {
+        break;
+      }
+
+      upvalue->closed = *upvalue->location;
+      upvalue->location = &upvalue->closed;
+      openUpvalues.pop_back();
+    }
+  }
+
+  void run() {
+    CallFrame *frame = &frames[frameCount - 1];
+    const std::uint8_t *ip = frame->ip;
+
+    auto readByte = [&ip]() { return *ip++; };
+    auto readShort = [&ip]() {
+      ip += 2;
+      return static_cast<std::uint16_t>((ip[-2] << 8) | ip[-1]);
+    };
+    auto readGlobal = [&]() {
+      ip += 4;
+      return static_cast<int>(
+          std::uint32_t{ip[-4]} << 24 | std::uint32_t{ip[-3]} << 16 |
+          std::uint32_t{ip[-2]} << 8 | std::uint32_t{ip[-1]});
+    };
+    auto readConstant = [&]() -> const Value & {
+      return frame->closure->getFunction()->chunk.constants[readShort()];
+    };
+    // Reports a runtime error at the current instruction
+    auto fail = [&](const std::string &message) {
+      frame->ip = ip;
+      runtimeError(message);
+    };
+
+    for (;;) {
+      std::uint8_t instruction = readByte();
+      switch (instruction) {
+      case OP_CONSTANT:
+        push(readConstant());
+        break;
+      case OP_NIL:
+        push(nullptr);
+        break;
+      case OP_TRUE:
+        push(true);
+        break;
+      case OP_FALSE:
+        push(false);
+        break;
+      case OP_POP:
+        pop();
+        break;
+
+      case OP_GET_LOCAL:
+        push(frame->slots[readByte()]);
+        break;
+      case OP_SET_LOCAL:
+        frame->slots[readByte()] = peek(0);
+        break;
+      case OP_GET_UPVALUE:
+        push(*frame->closure->getUpvalue(readByte())->location);
+        break;
+      case OP_SET_UPVALUE:
+        *frame->closure->getUpvalue(readByte())->location = peek(0);
+        break;
+
+      case OP_DEFINE_GLOBAL:
+        globals.define(readGlobal(), pop());
+        break;
+      case OP_GET_GLOBAL: {
+        int slot = readGlobal();
+        Value *value = globals.lookup(slot);
+        if (value == nullptr) {
+          fail("Undefined variable '" + globals.name(slot) + "'.");
+          return;
+        }
+        push(*value);
+        break;
+      }
+      case OP_SET_GLOBAL: {
+        int slot = readGlobal();
+        Value *value = globals.lookup(slot);
+        if (value == nullptr) {
+          fail("Undefined variable '" + globals.name(slot) + "'.");
+          return;
+        }
+        *value = peek(0);
+        break;
+      }
+
+      case OP_EQUAL: {
+        bool equal = isEqual(peek(1), peek(0));
+        pop();
+        peek(0) = equal;
+        break;
+      }
+      case OP_NOT_EQUAL: {
+        bool equal = isEqual(peek(1), peek(0));
+        pop();
+        peek(0) = !equal;
+        break;
+      }
+
+      case OP_GREATER:
+      case OP_GREATER_EQUAL:
+      case OP_LESS:
+      case OP_LESS_EQUAL:
+      case OP_SUBTRACT:
+      case OP_MULTIPLY:
+      case OP_DIVIDE: {
+        if (!peek(0).isNumber() || !peek(1).isNumber()) {
+          fail("Operands must be a number.");
+          return;
+        }
+        double b = pop().asNumber();
+        Value &a = peek(0);
+        switch (instruction) {
+        case OP_GREATER:
+          a = a.asNumber() > b;
+          break;
+        case OP_GREATER_EQUAL:
+          a = a.asNumber() >= b;
+          break;
+        case OP_LESS:
+          a = a.asNumber() < b;
+          break;
+        case OP_LESS_EQUAL:
+          a = a.asNumber() <= b;
+          break;
+        case OP_SUBTRACT:
+          a = a.asNumber() - b;
+          break;
+        case OP_MULTIPLY:
+          a = a.asNumber() * b;
+          break;
+        default:
+          a = a.asNumber() / b;
+          break;
+        }
+        break;
+      }
+      case OP_ADD: {
+        Value &a = peek(1);
+        Value &b = peek(0);
+        if (a.isNumber() && b.isNumber()) {
+          a = a.asNumber() + b.asNumber();
+        } else if (a.isString() && b.isString()) {
+          a = concatenate(a, b);
+        } else {
+          fail("Operands must be two numbers or two strings.");
+          return;
+        }
+        pop();
+        break;
+      }
+
+      case OP_NOT:
+        peek(0) = !isTruthy(peek(0));
+        break;
+      case OP_NEGATE:
+        if (!peek(0).isNumber()) {
+          fail("Operand must be a number.");
+          return;
+        }
+        peek(0) = -peek(0).asNumber();
+        break;
+
+      case OP_PRINT:
+        out << stringify(pop()) << "\n";
+        break;
+
+      case OP_JUMP: {
+        std::uint16_t offset = readShort();
+        ip += offset;
+        break;
+      }
+      case OP_JUMP_IF_FALSE: {
+        std::uint16_t offset = readShort();
+        if (!isTruthy(peek(0))) {
+          ip += offset;
+        }
+        break;
+      }
+      case OP_LOOP: {
+        std::uint16_t offset = readShort();
+        ip -= offset;
+        break;
+      }
+
+      case OP_CALL: {
+        int argCount = readByte();
+        frame->ip = ip;
+        if (!callValue(peek(argCount), argCount)) {
+          return;
+        }
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        break;
+      }
+      case OP_CLOSURE: {
+        push(Value{new ObjClosure{readConstant()}});
+        auto *closure = peek(0).asObj<ObjClosure>();
+        for (Value &upvalue : closure->upvalues) {
+          std::uint8_t isLocal = readByte();
+          std::uint8_t index = readByte();
+          if (isLocal != 0) {
+            upvalue = captureUpvalue(frame->slots + index);
+          } else {
+            upvalue = frame->closure->upvalues[index];
+          }
+        }
+        break;
+      }
+      case OP_CLOSE_UPVALUE:
+        closeUpvalues(stackTop - 1);
+        pop();
+        break;
+
+      case OP_TAIL_CALL: {
+        int argCount = readByte();
+        frame->ip = ip;
+        if (!peek(argCount).isObjType(ObjType::NATIVE)) {
+          if (!tailCall(argCount)) {
+            return;
+          }
+          ip = frame->ip;
+          break;
+        }
+        // A native has no frame to run in place of this one's, so call it
+        // and return its result
+        if (!callNative(argCount)) {
+          return;
+        }
+        [[fallthrough]];
+      }
+      case OP_RETURN: {
+        Value result = pop();
+        closeUpvalues(frame->slots);
+        frameCount--;
+
+        // Release the returning frame's locals and the callee itself
+        while (stackTop != frame->slots) {
+          *--stackTop = nullptr;
+        }
+
+        if (frameCount == 0) {
+          return;
+        }
+
+        push(std::move(result));
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        break;
+      }
+
+      default:
+        // Unreachable
+        return;
+      }
+    }
+  }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "LoxString.h"
+#include "LoxStringSlice.h"
+#include "Obj.h"
+#include <cstddef>
+#include <cstdint>
+#include <format> // std::format (c++20)
+#include <string>
+#include <string_view>
+
+enum class ValueType : std::uint8_t {
+  NIL,
+  BOOL,
+  NUMBER,
+  OBJ,
+};
+
+// A Lox runtime value: a type tag plus an unboxed payload.
+// Numbers, booleans and nil live inline; strings and functions are pointers to
+// reference-counted Obj instances.
+class Value {
+  ValueType type;
+  union {
+    bool boolean;
+    double number;
+    Obj *obj;
+  } as;
+
+public:
+  Value() : type{ValueType::NIL}, as{.obj = nullptr} {}
+
+  Value(std::nullptr_t) : Value() {}
+
+  Value(bool boolean) : type{ValueType::BOOL}, as{.boolean = boolean} {}
+
+  Value(double number) : type{ValueType::NUMBER}, as{.number = number} {}
+
+  // Takes a reference to obj. Freshly allocated objects start with no owners,
+  // so `Value{new ObjClosure{...}}` hands ownership to the Value.
+  Value(Obj *obj) : type{ValueType::OBJ}, as{.obj = obj} { retain(); }
+
+  // Prevent string literals from silently converting to bool
+  Value(const char *) = delete;
+
+  Value(const Value &other) : type{other.type}, as{other.as} { retain(); }
+
+  Value(Value &&other) noexcept : type{other.type}, as{other.as} {
+    other.type = ValueType::NIL;
+  }
+
+  Value &operator=(const Value &other) {
+    other.retain();
+    release();
+    type = other.type;
+    as = other.as;
+    return *this;
+  }
+
+  Value &operator=(Value &&other) noexcept {
+    if (this != &other) {
+      release();
+      type = other.type;
+      as = other.as;
+      other.type = ValueType::NIL;
+    }
+    return *this;
+  }
+
+  ~Value() { release(); }
+
+  [[nodiscard]] ValueType getType() const { return type; }
+
+  [[nodiscard]] bool isNil() const { return type == ValueType::NIL; }
+  [[nodiscard]] bool isBool() const { return type == ValueType::BOOL; }
+  [[nodiscard]] bool isNumber() const { return type == ValueType::NUMBER; }
+  [[nodiscard]] bool isObj() const { return type == ValueType::OBJ; }
+
+  [[nodiscard]] bool isObjType(ObjType objType) const {
+    return isObj() && as.obj->type == objType;
+  }
+
+  [[nodiscard]] bool isString() const {
+    return isObjType(ObjType::STRING) || isObjType(ObjType::STRING_SLICE);
+  }
+
+  [[nodiscard]] bool asBool() const { return as.boolean; }
+  [[nodiscard]] double asNumber() const { return as.number; }
+  [[nodiscard]] Obj *asObj() const { return as.obj; }
+
+  template <class T> [[nodiscard]] T *asObj() const {
+    return static_cast<T *>(as.obj);
+  }
+
+  [[nodiscard]] std::string_view asString() const {
+    if (as.obj->type == ObjType::STRING_SLICE) {
+      return asObj<LoxStringSlice>()->chars();
+    }
+    return asObj<LoxString>()->chars;
+  }
+
+private:
+  void retain() const {
+    if (type == ValueType::OBJ) {
+      as.obj->refCount++;
+    }
+  }
+
+  void release() {
+    if (type == ValueType::OBJ && --as.obj->refCount == 0) {
+      delete as.obj;
+    }
+  }
+};
+
+static_assert(sizeof(Value) == 16);
+
+inline bool isTruthy(const Value &object) {
+  if (object.isNil()) {
+    return false;
+  }
+  if (object.isBool()) {
+    return object.asBool();
+  }
+
+  return true;
+}
+
+inline bool isEqual(const Value &a, const Value &b) {
+  if (a.getType() != b.getType()) {
+    return false;
+  }
+
+  switch (a.getType()) {
+  case ValueType::NIL:
+    return true;
+  case ValueType::BOOL:
+    return a.asBool() == b.asBool();
+  case ValueType::NUMBER:
+    // returns false for (NaN == NaN), unlike jlox
+    return a.asNumber() == b.asNumber();
+  case ValueType::OBJ:
+    if (a.asObj() == b.asObj()) {
+      return true;
+    }
+    // Interned strings are equal only if they are the same object, but
+    // concatenated ones have to be compared by contents
+    if ((a.isObjType(ObjType::STRING_SLICE) && b.isString()) ||
+        (b.isObjType(ObjType::STRING_SLICE) && a.isString())) {
+      return a.asString() == b.asString();
+    }
+    return false;
+  }
+
+  return false;
+}
+
+// Both operands must be strings
+inline Value concatenate(const Value &a, const Value &b) {
+  if (a.isObjType(ObjType::STRING_SLICE)) {
+    return Value{a.asObj<LoxStringSlice>()->append(b.asString())};
+  }
+  return Value{LoxStringSlice::concatenate(a.asString(), b.asString())};
+}
+
+inline std::string stringify(const Value &object) {
+  switch (object.getType()) {
+  case ValueType::NIL:
+    return "nil";
+  case ValueType::BOOL:
+    return object.asBool() ? "true" : "false";
+  case ValueType::NUMBER:
+    // uses std::format (C++20) to match jlox floating point error behaviour
+    return std::format("{}", object.asNumber());
+  case ValueType::OBJ:
+    return object.asObj()->toString();
+  }
+
+  return "Error in stringify(): unsupported value type.";
+}
@@ -1,89 +1,234 @@
-#include "Error.h"
-#include "Interpreter.h"
-#include "Parser.h"
-#include "Resolver.h"
-#include "Scanner.h"
+#include "BytecodeCache.h"
+#include "Lox.h"
+#include "Source.h"
+#include "SourceReader.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv> // std::from_chars
+#include <condition_variable>
 #include <cstring>
-#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <sstream>
 #include <string>
-
-std::string readFile(const std::string_view path) {
-  std::ifstream file(path.data(), std::ios::binary);
-  if (!file) {
-    std::cerr << "Error reading file: " << path << std::strerror(errno) << '\n';
-    std::exit(74);
+#include <string_view>
+#include <system_error> // std::generic_category
+#include <thread>
+#include <vector>
+
+Lox::Options options{};
+// Set by --cache
+bool cache = false;
+// Set by --stream
+bool streaming = false;
+
+// Runs a script as it is read (see Lox::stream) and returns its exit status
+int streamFile(const std::string_view path, std::ostream &out,
+               std::ostream &err) {
+  std::unique_ptr<SourceReader> reader = SourceReader::open(path.data());
+  if (!reader) {
+    int code = errno;
+    err << "Error reading file: " << path
+        << std::generic_category().message(code) << '\n';
+    return 74;
   }
 
-  std::ostringstream buffer;
-  buffer << file.rdbuf();
-  file.close();
-
-  return buffer.str();
+  Lox lox{options, out, err};
+  lox.stream(*reader);
+  lox.report();
+  if (reader->error() != 0) {
+    err << "Error reading file: " << path
+        << std::generic_category().message(reader->error()) << '\n';
+    return 74;
+  }
+  return lox.status();
 }
 
-Interpreter interpreter{};
-
-void run(std::string_view source) {
-  Scanner scanner{source};
-  std::vector<Token> tokens = scanner.scanTokens();
-
-  Parser parser{tokens};
-  std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
-
-  // Stop if there was a syntax error
-  if (hadError) {
-    return;
+// Runs a script in a fresh Lox instance and returns its exit status
+int runFile(const std::string_view path, std::ostream &out, std::ostream &err) {
+  if (streaming) {
+    return streamFile(path, out, err);
   }
 
-  Resolver resolver{interpreter};
-  resolver.resolve(statements);
-
-  // Stop if there was a resolution error
-  if (hadError) {
-    return;
+  std::shared_ptr<const Source> source = Source::map(path.data());
+  if (!source) {
+    int code = errno;
+    err << "Error reading file: " << path
+        << std::generic_category().message(code) << '\n';
+    return 74;
   }
 
-  interpreter.interpret(statements);
+  Lox lox{options, out, err};
+  lox.run(std::move(source), cache ? BytecodeCache::path(path) : "");
+  lox.report();
+  return lox.status();
 }
 
-void runFile(const std::string_view path) {
-  std::string contents = readFile(path);
-  run(contents);
+// Runs every script in its own Lox instance, `jobs` at a time. Each script's
+// output is buffered and printed once it and the scripts before it are done,
+// so the output reads as if they had run one after another. Returns the exit
+// status of the first script that failed.
+int runFiles(std::span<const std::string_view> paths, unsigned jobs) {
+  struct Run {
+    std::ostringstream out;
+    std::ostringstream err;
+    int status = 0;
+    bool done = false;
+  };
+
+  std::vector<Run> runs(paths.size());
+  std::atomic<size_t> next = 0;
+  std::mutex mutex;
+  std::condition_variable finished;
+
+  auto work = [&] {
+    for (size_t i = next++; i < paths.size(); i = next++) {
+      Run &run = runs[i];
+      int status = runFile(paths[i], run.out, run.err);
+      {
+        std::lock_guard lock{mutex};
+        run.status = status;
+        run.done = true;
+      }
+      finished.notify_all();
+    }
+  };
 
-  if (hadError) {
-    std::exit(65);
+  std::vector<std::jthread> workers;
+  jobs = std::min<size_t>(jobs, paths.size());
+  for (unsigned i = 0; i < jobs; i++) {
+    workers.emplace_back(work);
   }
-  if (hadRuntimeError) {
-    std::exit(70);
+
+  int status = 0;
+  for (size_t i = 0; i < paths.size(); i++) {
+    Run &run = runs[i];
+    {
+      std::unique_lock lock{mutex};
+      finished.wait(lock, [&run] { return run.done; });
+    }
+    std::cout << run.out.view() << std::flush;
+    std::cerr << run.err.view();
+    if (run.status != 0) {
+      std::cerr << paths[i] << ": exit status " << run.status << '\n';
+      if (status == 0) {
+        status = run.status;
+      }
+    }
   }
+
+  return status;
 }
 
 void runPrompt() {
+  Lox lox{options, std::cout, std::cerr};
   std::string line;
   for (;;) {
     std::cout << "> ";
     if (!std::getline(std::cin, line)) {
       break;
     }
-    run(line);
-    hadError = false;
+    lox.run(std::make_shared<const Source>(std::move(line)));
+    lox.clearError();
   }
+  lox.report();
+}
+
+int usage() {
+  std::cerr << "Usage: cpplox [--engine=tree|vm|closure] [-O0|-O1] "
+               "[--profile[=csv|json]]\n"
+               "              [--line-profile] [--gc-growth=FACTOR] "
+               "[--gc-stats] [--cache]\n"
+               "              [--stream] [-j N] [filename...]"
+            << '\n';
+  return 64;
+}
+
+// Parses all of `text` as a number, or returns false
+template <class T> bool parse(std::string_view text, T &number) {
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), number);
+  return error == std::errc{} && end == text.data() + text.size();
 }
 
 int main(int argc, char *argv[]) {
-  if (argc > 2) {
-    std::cerr << "Usage: cpplox <filename>" << '\n';
-    return 64;
+  std::vector<std::string_view> files;
+  unsigned jobs = 1;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--engine=tree") {
+      options.engine = Engine::TREE;
+    } else if (arg == "--engine=vm") {
+      options.engine = Engine::VM;
+    } else if (arg == "--engine=closure") {
+      options.engine = Engine::CLOSURE;
+    } else if (arg == "-O0") {
+      options.optimize = false;
+    } else if (arg == "-O1") {
+      options.optimize = true;
+    } else if (arg == "--profile" || arg == "--profile=csv") {
+      options.profileFormat = Profiler::Format::CSV;
+    } else if (arg == "--profile=json") {
+      options.profileFormat = Profiler::Format::JSON;
+    } else if (arg == "--line-profile") {
+      options.lineProfile = true;
+    } else if (arg.starts_with("--gc-growth=")) {
+      arg.remove_prefix(std::strlen("--gc-growth="));
+      if (!parse(arg, options.gcGrowth) || options.gcGrowth <= 0) {
+        return usage();
+      }
+    } else if (arg == "--gc-stats") {
+      options.gcStats = true;
+    } else if (arg == "--cache") {
+      cache = true;
+    } else if (arg == "--stream") {
+      streaming = true;
+    } else if (arg.starts_with("-j")) {
+      // Either -jN or -j N
+      arg.remove_prefix(2);
+      if (arg.empty() && i + 1 < argc) {
+        arg = argv[++i];
+      }
+      if (!parse(arg, jobs) || jobs == 0) {
+        return usage();
+      }
+    } else if (arg.starts_with("-")) {
+      return usage();
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  // The VM has neither profiler
+  if (options.engine == Engine::VM && options.profileFormat) {
+    std::cerr << "--profile isn't supported by the vm engine\n";
+    return usage();
+  }
+  if (options.engine == Engine::VM && options.lineProfile) {
+    std::cerr << "--line-profile isn't supported by the vm engine\n";
+    return usage();
+  }
+
+  // A streamed script is never whole, so it has no line listing or cache file
+  if (streaming && options.lineProfile) {
+    std::cerr << "--line-profile can't be combined with --stream\n";
+    return usage();
+  }
+  if (streaming && cache) {
+    std::cerr << "--cache can't be combined with --stream\n";
+    return usage();
   }
 
-  if (argc == 2) {
-    runFile(argv[1]);
-  } else {
+  if (files.empty()) {
     runPrompt();
     return 0;
   }
 
-  return 0;
+  if (files.size() == 1) {
+    return runFile(files[0], std::cout, std::cerr);
+  }
+
+  return runFiles(files, jobs);
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "../src/Expr.h"
-#include <any>
 #include <cassert>
 #include <sstream> // std::ostringstream
 #include <string>
@@ -9,54 +8,54 @@
 
 class AstPrinter : public ExprVisitor {
 public:
-  std::string print(std::shared_ptr<Expr> expr) {
-    // casting the return value of accept() to the correct type
-    return std::any_cast<std::string>(expr->accept(*this));
+  std::string print(Expr *expr) {
+    // every visit method returns its rendering as a Lox string value
+    return std::string{expr->accept(*this).asString()};
   }
 
-  std::any visitBinaryExpr(std::shared_ptr<Binary> expr) override {
+  Value visitBinaryExpr(Binary *expr) override {
     return parenthesize(expr->op.lexeme, expr->left, expr->right);
   };
 
-  std::any visitGroupingExpr(std::shared_ptr<Grouping> expr) override {
+  Value visitGroupingExpr(Grouping *expr) override {
     return parenthesize("group", expr->expression);
   }
 
-  std::any visitLiteralExpr(std::shared_ptr<Literal> expr) override {
-    const auto &valueType = expr->value.type();
-
-    // Type narrowing with any_cast + converting to string
-    if (valueType == typeid(nullptr)) {
-      return "nil";
-    }
-    if (valueType == typeid(std::string)) {
-      return std::any_cast<std::string>(expr->value);
-    }
-    if (valueType == typeid(double)) {
-      return std::to_string(std::any_cast<double>(expr->value));
-    }
-    if (valueType == typeid(bool)) {
-      return std::any_cast<bool>(expr->value) ? "true" : "false";
+  Value visitLiteralExpr(Literal *expr) override {
+    const Value &value = expr->value;
+
+    switch (value.getType()) {
+    case ValueType::NIL:
+      return text("nil");
+    case ValueType::BOOL:
+      return text(value.asBool() ? "true" : "false");
+    case ValueType::NUMBER:
+      return text(std::to_string(value.asNumber()));
+    case ValueType::OBJ:
+      return text(value.asObj()->toString());
     }
 
-    return "Error in AstPrinter::visitLiteralExpr: literal type not "
-           "recognized.";
+    return text("Error in AstPrinter::visitLiteralExpr: literal type not "
+                "recognized.");
   }
 
-  std::any visitUnaryExpr(std::shared_ptr<Unary> expr) override {
+  Value visitUnaryExpr(Unary *expr) override {
     return parenthesize(expr->op.lexeme, expr->right);
   }
 
 private:
-  template <class... E>
-  std::string parenthesize(std::string_view name, E... expr) {
-    assert((... && std::is_same_v<E, std::shared_ptr<Expr>>));
+  static Value text(std::string str) {
+    return Value{LoxString::intern(std::move(str))};
+  }
+
+  template <class... E> Value parenthesize(std::string_view name, E... expr) {
+    assert((... && std::is_same_v<E, Expr *>));
 
     std::ostringstream builder;
     builder << '(' << name;
-    (..., (builder << " " << print(std::move(expr))));
+    (..., (builder << " " << print(expr)));
     builder << ")";
 
-    return builder.str();
+    return text(builder.str());
   }
 };
@@ -1,13 +1,15 @@
+#include "../src/Arena.h"
 #include "AstPrinter.h"
 #include <iostream>
 
 // should output "(* (- 123.000000) (group 45.670000))"
 int main() {
-  std::shared_ptr<Expr> expression = std::make_shared<Binary>(
-      std::make_shared<Unary>(Token{TokenType::MINUS, "-", nullptr, 1},
-                              std::make_shared<Literal>(123.)),
-      Token{TokenType::STAR, "*", nullptr, 1},
-      std::make_shared<Grouping>(std::make_shared<Literal>(45.67)));
+  Arena arena;
+  Expr *expression = arena.make<Binary>(
+      arena.make<Unary>(Token{TokenType::MINUS, "-", 1},
+                        arena.make<Literal>(123., 1)),
+      Token{TokenType::STAR, "*", 1},
+      arena.make<Grouping>(arena.make<Literal>(45.67, 1)));
 
   std::cout << AstPrinter().print(expression) << "\n";
   return 0;
@@ -0,0 +1,280 @@
+#include <algorithm> // std::sort
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h> // open
+#include <filesystem>
+#include <fstream>
+#include <iomanip> // std::setw
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/resource.h> // rusage
+#include <sys/wait.h>     // wait4
+#include <unistd.h>       // fork, execvp
+#include <vector>
+
+// Runs every Lox script in a directory several times under cpplox and reports
+// its median wall time, time per iteration and peak memory, compared against
+// a baseline file.
+//
+// Each script declares how much work it does in a leading comment,
+// `// iterations: N`, which is what "per iteration" is measured against.
+
+struct Result {
+  double wallMs = 0;
+  double nsPerIteration = 0;
+  long peakRssKb = 0;
+};
+
+struct Options {
+  std::string benchDir = "bench";
+  std::string baseline = "bench/baseline.json";
+  int runs = 5;
+  double threshold = 10; // percent
+  bool update = false;
+  // Delete each script's bytecode cache (see src/BytecodeCache.h) before
+  // every run, to measure startup without it
+  bool cold = false;
+  std::vector<std::string> command; // cpplox and its flags
+};
+
+int usage() {
+  std::cerr << "Usage: bench [--runs N] [--threshold PERCENT] [--dir DIR] "
+               "[--baseline FILE] [--update] [--cold] -- cpplox [flags]"
+            << '\n';
+  return 64;
+}
+
+long iterations(const std::filesystem::path &script) {
+  std::ifstream file(script);
+  std::string line;
+  std::getline(file, line);
+
+  constexpr std::string_view prefix = "// iterations:";
+  if (!line.starts_with(prefix)) {
+    return 1;
+  }
+  return std::stol(line.substr(prefix.size()));
+}
+
+// Runs one script to completion, returning nothing if it failed
+std::optional<Result> runOnce(const Options &options,
+                              const std::filesystem::path &script) {
+  std::vector<std::string> args = options.command;
+  args.push_back(script.string());
+  std::vector<char *> argv;
+  for (std::string &arg : args) {
+    argv.push_back(arg.data());
+  }
+  argv.push_back(nullptr);
+
+  if (options.cold) {
+    std::error_code ignored;
+    std::filesystem::remove(script.string() + "c", ignored);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == -1) {
+    return std::nullopt;
+  }
+  if (pid == 0) {
+    // Scripts print their result; only the timing is interesting here
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    execvp(argv[0], argv.data());
+    std::_Exit(127);
+  }
+
+  int status = 0;
+  rusage usage{};
+  wait4(pid, &status, 0, &usage);
+  auto end = std::chrono::steady_clock::now();
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    return std::nullopt;
+  }
+
+  Result result;
+  result.wallMs =
+      std::chrono::duration<double, std::milli>(end - start).count();
+  // Kilobytes on Linux
+  result.peakRssKb = usage.ru_maxrss;
+  return result;
+}
+
+std::optional<Result> run(const Options &options,
+                          const std::filesystem::path &script) {
+  std::vector<Result> results;
+  for (int i = 0; i < options.runs; i++) {
+    std::optional<Result> result = runOnce(options, script);
+    if (!result) {
+      return std::nullopt;
+    }
+    results.push_back(*result);
+  }
+
+  auto faster = [](const Result &a, const Result &b) {
+    return a.wallMs < b.wallMs;
+  };
+  std::sort(results.begin(), results.end(), faster);
+  Result median = results[results.size() / 2];
+  median.nsPerIteration = median.wallMs * 1e6 / iterations(script);
+  return median;
+}
+
+// The baseline is a flat JSON object mapping each benchmark name to an object
+// of numbers. This reads exactly the format writeBaseline produces.
+std::map<std::string, Result> readBaseline(const std::string &path) {
+  std::map<std::string, Result> baseline;
+  std::ifstream file(path);
+  if (!file) {
+    return baseline;
+  }
+
+  std::string line;
+  std::string name;
+  while (std::getline(file, line)) {
+    std::string_view text = line;
+    size_t quote = text.find('"');
+    if (quote == std::string_view::npos) {
+      continue;
+    }
+    size_t close = text.find('"', quote + 1);
+    std::string key{text.substr(quote + 1, close - quote - 1)};
+    std::string_view rest = text.substr(close + 1);
+    rest.remove_prefix(std::min(rest.find(':') + 1, rest.size()));
+
+    if (rest.find('{') != std::string_view::npos) {
+      name = key;
+    } else if (!name.empty()) {
+      double value = std::strtod(std::string{rest}.c_str(), nullptr);
+      if (key == "wall_ms") {
+        baseline[name].wallMs = value;
+      } else if (key == "ns_per_iteration") {
+        baseline[name].nsPerIteration = value;
+      } else if (key == "peak_rss_kb") {
+        baseline[name].peakRssKb = static_cast<long>(value);
+      }
+    }
+  }
+
+  return baseline;
+}
+
+void writeBaseline(const std::string &path,
+                   const std::map<std::string, Result> &results) {
+  std::ofstream file(path);
+  file << std::fixed << std::setprecision(2) << "{\n";
+
+  size_t i = 0;
+  for (const auto &[name, result] : results) {
+    file << "  \"" << name << "\": {\n"
+         << "    \"wall_ms\": " << result.wallMs << ",\n"
+         << "    \"ns_per_iteration\": " << result.nsPerIteration << ",\n"
+         << "    \"peak_rss_kb\": " << result.peakRssKb << "\n"
+         << "  }" << (++i < results.size() ? "," : "") << "\n";
+  }
+
+  file << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--") {
+      options.command.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    if (arg == "--update") {
+      options.update = true;
+    } else if (arg == "--cold") {
+      options.cold = true;
+    } else if (i + 1 < argc && arg == "--runs") {
+      options.runs = std::max(1, std::atoi(argv[++i]));
+    } else if (i + 1 < argc && arg == "--threshold") {
+      options.threshold = std::atof(argv[++i]);
+    } else if (i + 1 < argc && arg == "--dir") {
+      options.benchDir = argv[++i];
+    } else if (i + 1 < argc && arg == "--baseline") {
+      options.baseline = argv[++i];
+    } else {
+      return usage();
+    }
+  }
+
+  if (options.command.empty()) {
+    return usage();
+  }
+
+  std::vector<std::filesystem::path> scripts;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(options.benchDir)) {
+    if (entry.path().extension() == ".lox") {
+      scripts.push_back(entry.path());
+    }
+  }
+  std::sort(scripts.begin(), scripts.end());
+
+  std::map<std::string, Result> baseline = readBaseline(options.baseline);
+  std::map<std::string, Result> results;
+  std::vector<std::string> regressions;
+  bool failed = false;
+
+  std::cout << std::left << std::setw(12) << "benchmark" << std::right
+            << std::setw(12) << "wall ms" << std::setw(12) << "ns/iter"
+            << std::setw(12) << "peak KB" << std::setw(14) << "baseline ms"
+            << std::setw(10) << "change" << '\n';
+
+  for (const std::filesystem::path &script : scripts) {
+    std::string name = script.stem().string();
+    std::optional<Result> result = run(options, script);
+
+    std::cout << std::left << std::setw(12) << name << std::right;
+    if (!result) {
+      std::cout << "  FAILED\n";
+      failed = true;
+      continue;
+    }
+    results[name] = *result;
+
+    std::cout << std::fixed << std::setprecision(1) << std::setw(12)
+              << result->wallMs << std::setw(12) << result->nsPerIteration
+              << std::setw(12) << result->peakRssKb;
+
+    auto found = baseline.find(name);
+    if (found != baseline.end() && found->second.wallMs > 0) {
+      double change = (result->wallMs / found->second.wallMs - 1) * 100;
+      std::ostringstream percent;
+      percent << std::showpos << std::fixed << std::setprecision(1) << change
+              << '%';
+      std::cout << std::setw(14) << found->second.wallMs << std::setw(10)
+                << percent.str();
+      if (change > options.threshold) {
+        regressions.push_back(name);
+        std::cout << "  REGRESSION";
+      }
+    }
+    std::cout << '\n';
+  }
+
+  if (options.update && !failed) {
+    writeBaseline(options.baseline, results);
+    std::cout << "Wrote " << options.baseline << '\n';
+    return 0;
+  }
+
+  if (failed) {
+    return 1;
+  }
+  if (!regressions.empty()) {
+    std::cout << regressions.size() << " benchmark(s) more than "
+              << options.threshold << "% slower than the baseline\n";
+    return 1;
+  }
+  return 0;
+}
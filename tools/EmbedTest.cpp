@@ -0,0 +1,107 @@
+#include "../src/Lox.h"
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+// Exercises libcpplox the way a host embeds it (see src/Lox.h and the README)
+// on every engine: scripts compiled once and executed several times, globals
+// defined by the host, resetGlobals(), a native and a script executed by the
+// wrong instance. Prints each check that fails and exits with 1 if any did.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, std::string_view engine, std::string_view what) {
+  if (!condition) {
+    std::cerr << engine << ": " << what << '\n';
+    failures++;
+  }
+}
+
+std::string greet(std::string_view name) {
+  return "hello " + std::string{name};
+}
+
+std::optional<CompiledScript> compile(Lox &lox, std::string text) {
+  return lox.compile(std::make_shared<const Source>(std::move(text)));
+}
+
+bool hasNumber(Lox &lox, std::string_view name, double number) {
+  const Value *value = lox.global(name);
+  return value != nullptr && value->isNumber() && value->asNumber() == number;
+}
+
+void test(Engine engine, std::string_view name) {
+  std::ostringstream out;
+  std::ostringstream err;
+  Lox lox{Lox::Options{.engine = engine}, out, err};
+  lox.defineNative<greet>("greet");
+
+  // Compiled once, executed once per record
+  std::optional<CompiledScript> rule =
+      compile(lox, "print greet(who);\nvar result = amount * 2;\n");
+  check(rule.has_value(), name, "rule didn't compile");
+  if (!rule) {
+    return;
+  }
+  const char *names[] = {"ann", "bob", "cy"};
+  for (int i = 0; i < 3; i++) {
+    lox.resetGlobals();
+    lox.define("amount", i + 1.0);
+    lox.define("who", Value{LoxString::intern(names[i])});
+    check(lox.execute(*rule), name, "rule failed");
+    check(hasNumber(lox, "result", (i + 1) * 2.0), name, "wrong result");
+  }
+  check(out.str() == "hello ann\nhello bob\nhello cy\n", name,
+        "rule printed \"" + out.str() + "\"");
+
+  // resetGlobals() leaves only the natives, the host's included
+  lox.resetGlobals();
+  check(lox.global("result") == nullptr, name, "result survived a reset");
+  check(lox.global("amount") == nullptr, name, "amount survived a reset");
+  check(lox.global("greet") != nullptr, name, "greet didn't survive a reset");
+  check(lox.global("clock") != nullptr, name, "clock didn't survive a reset");
+  check(!lox.execute(*rule), name, "rule ran without amount");
+  check(lox.status() == 70, name, "no runtime error without amount");
+
+  // Globals carry over from one execution to the next until reset
+  std::optional<CompiledScript> counter = compile(lox, "count = count + 1;");
+  check(counter.has_value(), name, "counter didn't compile");
+  if (!counter) {
+    return;
+  }
+  lox.define("count", 0.0);
+  for (int i = 0; i < 3; i++) {
+    check(lox.execute(*counter), name, "counter failed");
+  }
+  check(hasNumber(lox, "count", 3), name, "wrong count");
+
+  // Natives check their argument types
+  std::optional<CompiledScript> misuse = compile(lox, "greet(1);");
+  check(misuse.has_value() && !lox.execute(*misuse), name,
+        "greet accepted a number");
+
+  check(!compile(lox, "print ;").has_value(), name, "syntax error compiled");
+  check(lox.status() == 65, name, "no syntax error status");
+
+  // A script only runs on the instance that compiled it
+  std::ostringstream otherErr;
+  Lox other{Lox::Options{.engine = engine}, out, otherErr};
+  check(!other.execute(*rule), name, "another instance ran the rule");
+  check(other.status() == 70, name, "no runtime error on another instance");
+  check(otherErr.str() == "Script compiled by another Lox instance.\n", name,
+        "another instance reported \"" + otherErr.str() + "\"");
+}
+
+} // namespace
+
+int main() {
+  test(Engine::TREE, "tree");
+  test(Engine::VM, "vm");
+  test(Engine::CLOSURE, "closure");
+  return failures == 0 ? 0 : 1;
+}
@@ -45,43 +45,62 @@ std::string toLowerCase(std::string_view str) {
   return lowered;
 }
 
-// Allows us to use "*" in metaprogram to indicate a smart pointer
-std::string fix_pointer(std::string_view field) {
-  std::ostringstream out;
-  std::string_view type = split(field, " ")[0];
-  std::string_view name = split(field, " ")[1];
-  bool close_bracket = false;
-
-  if (type.starts_with("std::vector<")) {
-    out << "std::vector<";
-    type = type.substr(12, type.length() - 13); // ignore closing '>'
-    close_bracket = true;
+// Allows us to use "*" in metaprogram to indicate a pointer to an
+// arena-allocated node, and "[]" to indicate an arena-allocated array
+std::string fieldType(std::string_view type) {
+  if (type.ends_with("[]")) {
+    type.remove_suffix(2);
+    if (type.back() == '*') {
+      type.remove_suffix(1);
+      return "std::span<" + std::string{type} + " *const>";
+    }
+    return "std::span<const " + std::string{type} + ">";
   }
 
   if (type.back() == '*') {
     type.remove_suffix(1);
-    out << "std::shared_ptr<" << type << ">";
-  } else {
-    out << type;
+    return std::string{type} + " *";
   }
 
-  if (close_bracket) {
-    out << ">";
+  return std::string{type};
+}
+
+// Pointers and spans are cheap to copy, so they are not std::move'd
+bool isView(std::string_view type) {
+  return type.back() == '*' || type.ends_with("[]");
+}
+
+// Constructor parameter, e.g. "Expr *left" or "Token op"
+std::string parameter(std::string_view field) {
+  std::string type = fieldType(split(field, " ")[0]);
+  std::string_view name = split(field, " ")[1];
+
+  if (type.back() == '*') {
+    return type + std::string{name};
   }
-  out << " " << name;
+  return type + " " + std::string{name};
+}
+
+// Member declaration, e.g. "Expr *const left" or "const Token op"
+std::string member(std::string_view field) {
+  std::string type = fieldType(split(field, " ")[0]);
+  std::string_view name = split(field, " ")[1];
 
-  return out.str();
+  if (type.back() == '*') {
+    return type + "const " + std::string{name};
+  }
+  return "const " + type + " " + std::string{name};
 }
 
 void defineVisitor(std::ostream &writer, std::string_view baseName,
+                   std::string_view returnType,
                    const std::vector<std::string_view> &types) {
   writer << "struct " << baseName << "Visitor {\n";
 
   for (std::string_view type : types) {
     std::string_view typeName = trim(split(type, "->")[0]);
-    writer << "  virtual std::any visit" << typeName << baseName
-           << "(std::shared_ptr<" << typeName << "> " << toLowerCase(baseName)
-           << ") = 0;\n";
+    writer << "  virtual " << returnType << " visit" << typeName << baseName
+           << "(" << typeName << " *" << toLowerCase(baseName) << ") = 0;\n";
   }
 
   writer << "\n  virtual ~" << baseName << "Visitor() = default;\n";
@@ -90,51 +109,70 @@ void defineVisitor(std::ostream &writer, std::string_view baseName,
 }
 
 void defineType(std::ofstream &writer, std::string_view baseName,
-                std::string_view className, std::string_view fieldList) {
+                std::string_view returnType, std::string_view className,
+                std::string_view fieldList) {
 
-  writer << "struct " << className << " : " << baseName
-         << ", public std::enable_shared_from_this<" << className << "> {\n";
+  writer << "struct " << className << " : " << baseName << " {\n";
 
   // Constructor
   writer << "  " << className << "(";
 
-  std::vector<std::string_view> fields = split(fieldList, ", ");
+  // Fields marked "mutable" are not constructor parameters: they start
+  // value-initialized and are filled in by later passes (e.g. the Resolver).
+  std::vector<std::string_view> fields;
+  std::vector<std::string_view> mutableFields;
+  for (std::string_view field : split(fieldList, ", ")) {
+    if (field.starts_with("mutable ")) {
+      field.remove_prefix(8);
+      mutableFields.push_back(field);
+    } else {
+      fields.push_back(field);
+    }
+  }
 
-  writer << fix_pointer(fields[0]);
+  writer << parameter(fields[0]);
   for (size_t i = 1; i < fields.size(); i++) {
-    writer << ", " << fix_pointer(fields[i]);
+    writer << ", " << parameter(fields[i]);
   }
 
   writer << ")\n" << "      : ";
 
   // Store parameters in fields
-  std::string_view name = split(fields[0], " ")[1];
-
-  writer << name << "{std::move(" << name << ")}";
-  for (size_t i = 1; i < fields.size(); i++) {
-    name = split(fields[i], " ")[1];
-    writer << ", " << name << "{std::move(" << name << ")}";
+  for (size_t i = 0; i < fields.size(); i++) {
+    std::string_view type = split(fields[i], " ")[0];
+    std::string_view name = split(fields[i], " ")[1];
+
+    writer << (i == 0 ? "" : ", ") << name;
+    if (isView(type)) {
+      writer << "{" << name << "}";
+    } else {
+      writer << "{std::move(" << name << ")}";
+    }
   }
 
   writer << " {}\n";
 
   // Visitor pattern
   writer << "\n";
-  writer << "  std::any accept(" << baseName
+  writer << "  " << returnType << " accept(" << baseName
          << "Visitor &visitor) override {\n"
             "    return visitor.visit"
-         << className << baseName << "(shared_from_this());\n"
+         << className << baseName << "(this);\n"
          << "  }\n";
 
   // Fields
   writer << "\n";
   for (std::string_view field : fields) {
-    writer << "  const " << fix_pointer(field) << ";\n";
+    writer << "  " << member(field) << ";\n";
+  }
+  for (std::string_view field : mutableFields) {
+    writer << "  " << parameter(field) << "{};\n";
   }
   writer << "};\n\n";
 }
 
 void defineAst(const std::string &outputDir, const std::string &baseName,
+               std::string_view returnType,
                const std::vector<std::string_view> &types) {
   std::string path = outputDir + "/" + baseName + ".h";
   std::ofstream writer{path};
@@ -147,11 +185,11 @@ void defineAst(const std::string &outputDir, const std::string &baseName,
   writer << "#pragma once\n\n";
 
   if (baseName == "Expr") {
-    writer << "#include \"Token.h\"\n"
-              "#include <any>\n"
-              "#include <memory>  // std::shared_ptr\n"
+    writer << "#include \"Binding.h\"\n"
+              "#include \"Token.h\"\n"
+              "#include \"Value.h\"\n"
+              "#include <span>\n"
               "#include <utility> // std::move\n"
-              "#include <vector>\n"
               "\n";
   } else {
     writer << "#include \"Expr.h\"\n"
@@ -167,7 +205,7 @@ void defineAst(const std::string &outputDir, const std::string &baseName,
 
   // Visitor
   writer << "// GenerateAst.cpp > defineVisitor()\n";
-  defineVisitor(writer, baseName, types);
+  defineVisitor(writer, baseName, returnType, types);
   writer << "\n";
 
   // Base class
@@ -175,12 +213,14 @@ void defineAst(const std::string &outputDir, const std::string &baseName,
   // Virtual function dispatch happens at runtime in C++, while template
   // instantiation happens at compile time, so we cannot type template our
   // virtual accept() method.
-  // Instead, we use std::any type, passing the responsibility of casting the
-  // return value to the correct type to the caller of accept().
+  // Instead, each tree has a single fixed return type: expressions produce a
+  // Value, statements produce nothing.
 
   writer << "struct " << baseName
          << " {\n"
-            "  virtual std::any accept("
+            "  virtual "
+         << returnType
+         << " accept("
          << baseName
          << "Visitor &visitor) = 0;\n"
          // added virtual destructor to Expr
@@ -192,7 +232,7 @@ void defineAst(const std::string &outputDir, const std::string &baseName,
   for (std::string_view type : types) {
     std::string_view className = trim(split(type, "->")[0]);
     std::string_view fields = trim(split(type, "->")[1]);
-    defineType(writer, baseName, className, fields);
+    defineType(writer, baseName, returnType, className, fields);
   }
 }
 
@@ -205,31 +245,31 @@ int main(int argc, char *argv[]) {
   std::string outputDir = argv[1];
 
   // delimiter has been changed to '->' (from ':')
-  // to allow for `std::any` in fields
+  // to allow for `::` in field types
   defineAst(
-      outputDir, "Expr",
+      outputDir, "Expr", "Value",
       {
-          "Assign   -> Token name, Expr* value",
+          "Assign   -> Token name, Expr* value, mutable Binding binding",
           "Binary   -> Expr* left, Token op, Expr* right",
-          "Call     -> Expr* callee, Token paren, std::vector<Expr*> arguments",
+          "Call     -> Expr* callee, Token paren, Expr*[] arguments",
           "Grouping -> Expr* expression",
-          "Literal  -> std::any value",
+          "Literal  -> Value value, int line",
           "Logical  -> Expr* left, Token op, Expr* right",
           "Unary    -> Token op, Expr* right",
-          "Variable -> Token name",
+          "Variable -> Token name, mutable Binding binding",
       });
 
   defineAst(
-      outputDir, "Stmt",
+      outputDir, "Stmt", "void",
       {
-          "Block      -> std::vector<Stmt*> statements",
+          "Block      -> Stmt*[] statements, mutable bool captured",
           "Expression -> Expr* expression",
-          "Function   -> Token name, std::vector<Token> params,"
-          " std::vector<Stmt*> body",
+          "Function   -> Token name, Token[] params, Stmt*[] body, "
+          "mutable bool captured, mutable Binding binding",
           "If         -> Expr* condition, Stmt* thenBranch, Stmt* elseBranch",
           "Print      -> Expr* expression",
-          "Return     -> Token keyword, Expr* value",
-          "Var        -> Token name, Expr* initializer",
+          "Return     -> Token keyword, Expr* value, mutable bool tail",
+          "Var        -> Token name, Expr* initializer, mutable Binding binding",
           "While      -> Expr* condition, Stmt* body",
       });
 }